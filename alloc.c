@@ -147,6 +147,28 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <pthread.h>
+
+/* In the malloc shim (malloc_shim.c) this file is compiled with -DSHIM:
+ * malloc() is then the shim itself, so the index and any fallback
+ * region come from glibc's own allocator, and nothing is printed into
+ * the output of the host program. */
+
+#ifdef SHIM
+void *__libc_malloc( size_t size );
+void *__libc_calloc( size_t count, size_t size );
+void *__libc_realloc( void *ptr, size_t size );
+void __libc_free( void *ptr );
+#define malloc __libc_malloc
+#define calloc __libc_calloc
+#define realloc __libc_realloc
+#define free __libc_free
+#define printf(...) ((void) 0)
+#endif
 
 /* global data structures */
 
@@ -164,16 +186,551 @@ printf("*** at %s, ptr is %p, sig is %s\n",(z),(w),(char *)(w)+1);}}
 #define ENDSIGCHK(a,b) {SIGCHK((a),"end_",4,(b))}
 
 char *region_base;
+size_t region_length;
+struct tag_block *region_top;
 
 
 /* function headers */
 int free_size();
+void *alloc_mem( unsigned int amount );
+void *alloc_mem_aligned( unsigned int amount, unsigned int align );
+void tiny_reset();
+unsigned int release_mem( void *ptr );
 
-void init_region(){
+/* out-of-band free block index
+ *
+ * The fit search in alloc_mem() reads only a dense side array of
+ * block sizes instead of the tag block of every free block on the
+ * list, so the heap itself is touched only for the block chosen.
+ *
+ *   fi_size[i]    size of the free block of entry i, 0 for a dead entry
+ *   fi_offset[i]  offset of that free block's node from region_base
+ *
+ * The live entries are in the reverse order of the free list, so that
+ * adding a node at the head of the list appends an entry and first fit
+ * scans the arrays downward from the last entry. Removed entries are
+ * left dead in place (a size of 0 never satisfies a request) and the
+ * arrays are compacted once more than half of the entries are dead.
+ *
+ * Coalescing in release_mem() has to find the entry of a neighbouring
+ * free block, so an open-addressing hash table maps node offsets to
+ * entry indexes (fi_key[] is 0 for an empty slot; no node is at offset
+ * 0). The arrays and the table live outside the region and grow by
+ * doubling.
+ *
+ * For alloc_mem_near(), fi_page[p] counts the ends of free blocks in
+ * the p-th 4 KiB page (1 << FI_PAGE_SHIFT bytes) of the region: each
+ * entry adds one for the page of its node, just below its top tag, and
+ * one for the page of its ending tag, at fi_offset + fi_size. A free
+ * block that reaches into a run of pages without either end in it must
+ * cover the whole run, so pages whose counts are all 0 are free of free
+ * blocks unless one block spans all of them. Changes to the size of an
+ * entry go through fi_resize() so that the count of the ending tag
+ * follows it.
+ */
+
+#define FI_PAGE_SHIFT 12
+
+unsigned int *fi_size, *fi_offset;
+unsigned int fi_count, fi_dead, fi_capacity;
+unsigned int *fi_key, *fi_val;
+unsigned int fi_hash_mask;
+unsigned short *fi_page;
+
+#define FI_OFFSET(fb) ((unsigned int)((char *)(fb) - region_base))
+#define FI_BLOCK(off) ((struct free_block *)(region_base + (off)))
+#define FI_HASH(off) ((((off) >> 4) * 2654435761U) & fi_hash_mask)
+#define FI_PAGE(off) ((off) >> FI_PAGE_SHIFT)
+
+void fi_hash_put( unsigned int off, unsigned int i ){
+  unsigned int h = FI_HASH(off);
+  while( fi_key[h] != 0 && fi_key[h] != off ) h = ( h + 1 ) & fi_hash_mask;
+  fi_key[h] = off;
+  fi_val[h] = i;
+}
+
+unsigned int fi_lookup( struct free_block *fb ){
+  unsigned int off = FI_OFFSET(fb), h = FI_HASH(off);
+  while( fi_key[h] != off ) h = ( h + 1 ) & fi_hash_mask;
+  return fi_val[h];
+}
+
+/* the same, or -1 if the node has no entry */
+
+int fi_find( struct free_block *fb ){
+  unsigned int off = FI_OFFSET(fb), h = FI_HASH(off);
+  while( fi_key[h] != 0 ){
+    if( fi_key[h] == off ) return fi_val[h];
+    h = ( h + 1 ) & fi_hash_mask;
+  }
+  return -1;
+}
+
+/* remove a key by shifting later members of its probe run back */
+
+void fi_hash_delete( unsigned int off ){
+  unsigned int h = FI_HASH(off), j, home;
+
+  while( fi_key[h] != off ) h = ( h + 1 ) & fi_hash_mask;
+  j = h;
+  for( ;; ){
+    fi_key[h] = 0;
+    do {
+      j = ( j + 1 ) & fi_hash_mask;
+      if( fi_key[j] == 0 ) return;
+      home = FI_HASH(fi_key[j]);
+    } while( ( h <= j ) ? ( h < home && home <= j ) : ( h < home || home <= j ) );
+    fi_key[h] = fi_key[j];
+    fi_val[h] = fi_val[j];
+    h = j;
+  }
+}
+
+/* rebuild the table for the live entries, dropping dead ones first */
+
+void fi_rebuild(){
+  unsigned int i, n = 0;
+
+  for( i = 0; i < fi_count; i++ ){
+    if( fi_size[i] == 0 ) continue;
+    fi_size[n] = fi_size[i];
+    fi_offset[n] = fi_offset[i];
+    n++;
+  }
+  fi_count = n;
+  fi_dead = 0;
+
+  memset( fi_key, 0, ( fi_hash_mask + 1 ) * sizeof( unsigned int ) );
+  for( i = 0; i < fi_count; i++ ) fi_hash_put( fi_offset[i], i );
+}
+
+/* add delta to the page counts of both ends of entry i's block */
+
+void fi_page_add( unsigned int i, int delta ){
+  fi_page[FI_PAGE(fi_offset[i])] += delta;
+  fi_page[FI_PAGE(fi_offset[i] + fi_size[i])] += delta;
+}
+
+void fi_reset(){
+  free( fi_size ); free( fi_offset ); free( fi_key ); free( fi_val ); free( fi_page );
+  fi_capacity = 64;
+  fi_hash_mask = 2 * fi_capacity - 1;
+  fi_size = (unsigned int *) malloc( fi_capacity * sizeof( unsigned int ) );
+  fi_offset = (unsigned int *) malloc( fi_capacity * sizeof( unsigned int ) );
+  fi_key = (unsigned int *) calloc( fi_hash_mask + 1, sizeof( unsigned int ) );
+  fi_val = (unsigned int *) malloc( ( fi_hash_mask + 1 ) * sizeof( unsigned int ) );
+  fi_page = (unsigned short *) calloc( FI_PAGE(region_length) + 2, sizeof( unsigned short ) );
+  if( fi_size == NULL || fi_offset == NULL || fi_key == NULL || fi_val == NULL || fi_page == NULL ){
+    printf( "no memory!\n" ); exit(0);
+  }
+  fi_count = 0;
+  fi_dead = 0;
+}
+
+/* add an entry for a node just put at the head of the free list */
+
+void fi_insert( struct free_block *fb, unsigned int size ){
+  if( fi_count == fi_capacity ){
+    if( fi_dead > 0 ){
+      fi_rebuild();
+    }else{
+      fi_capacity *= 2;
+      fi_hash_mask = 2 * fi_capacity - 1;
+      fi_size = (unsigned int *) realloc( fi_size, fi_capacity * sizeof( unsigned int ) );
+      fi_offset = (unsigned int *) realloc( fi_offset, fi_capacity * sizeof( unsigned int ) );
+      fi_key = (unsigned int *) realloc( fi_key, ( fi_hash_mask + 1 ) * sizeof( unsigned int ) );
+      fi_val = (unsigned int *) realloc( fi_val, ( fi_hash_mask + 1 ) * sizeof( unsigned int ) );
+      if( fi_size == NULL || fi_offset == NULL || fi_key == NULL || fi_val == NULL ){
+        printf( "no memory!\n" ); exit(0);
+      }
+      fi_rebuild();
+    }
+  }
+  fi_size[fi_count] = size;
+  fi_offset[fi_count] = FI_OFFSET(fb);
+  fi_hash_put( fi_offset[fi_count], fi_count );
+  fi_page_add( fi_count, 1 );
+  fi_count++;
+}
+
+void fi_remove( unsigned int i ){
+  fi_hash_delete( fi_offset[i] );
+  fi_page_add( i, -1 );
+  fi_size[i] = 0;
+  fi_dead++;
+  if( fi_dead > 32 && fi_dead > fi_count / 2 ) fi_rebuild();
+}
+
+/* point entry i at a node that took over another node's list position */
+
+void fi_move( unsigned int i, struct free_block *fb ){
+  fi_hash_delete( fi_offset[i] );
+  fi_page_add( i, -1 );
+  fi_offset[i] = FI_OFFSET(fb);
+  fi_hash_put( fi_offset[i], i );
+  fi_page_add( i, 1 );
+}
+
+/* set the size of entry i's block */
+
+void fi_resize( unsigned int i, unsigned int size ){
+  fi_page_add( i, -1 );
+  fi_size[i] = size;
+  fi_page_add( i, 1 );
+}
+
+/* return the first entry, in free list order, of a block of at least
+ * "size" bytes, or -1 if there is none; sizes are tested eight at a
+ * time so the compiler can use vector compares; fi_scanned is set to
+ * the number of entries (live or dead) up to the one returned */
+
+unsigned int fi_scanned;
+
+int fi_search( unsigned int size ){
+  unsigned int i = fi_count, j, any;
+
+  while( i >= 8 ){
+    any = 0;
+    for( j = i - 8; j < i; j++ ) any |= ( fi_size[j] >= size );
+    if( any ){
+      for( j = i; j-- > i - 8; ) if( fi_size[j] >= size ){ fi_scanned = fi_count - j; return j; }
+    }
+    i -= 8;
+  }
+  while( i-- > 0 ) if( fi_size[i] >= size ){ fi_scanned = fi_count - i; return i; }
+  fi_scanned = fi_count;
+  return -1;
+}
+
+
+/* region backing
+ *
+ *   REGION_MALLOC    the region comes from malloc(), as in init_region()
+ *   REGION_HUGEPAGE  the region is mapped with mmap() at a 2 MiB
+ *                    boundary and its length is rounded up to whole
+ *                    2 MiB pages; it is backed by MAP_HUGETLB pages if
+ *                    the system has them reserved, and otherwise by
+ *                    transparent huge pages requested with
+ *                    madvise(MADV_HUGEPAGE); if the mapping cannot be
+ *                    made at all, malloc() is used instead
+ *
+ *   REGION_RESERVE   the whole region is reserved with a PROT_NONE
+ *                    mapping and memory is committed only as it is
+ *                    used; see commit_region() below
+ *
+ *   REGION_BUDDY     the region comes from malloc() and is managed by
+ *                    the buddy engine of buddy_alloc.c instead of the
+ *                    boundary tags; see allocation engines below
+ *
+ * In REGION_HUGEPAGE mode alloc_mem() also prefers, among the free
+ * blocks that fit, one whose allocation does not break into a huge
+ * page that is still wholly free, so that whole huge pages stay
+ * intact for as long as blocks crossing partly used ones can serve
+ * the requests.
+ */
+
+#define REGION_MALLOC 0
+#define REGION_HUGEPAGE 1
+#define REGION_RESERVE 2
+#define REGION_BUDDY 3
+#define HUGE_PAGE_SIZE (2 * 1024 * 1024)
+#define COMMIT_STEP (64 * 1024)
+
+int region_mode = REGION_MALLOC;
+const char *region_backing = "malloc";
+
+/* map a 2 MiB-aligned region of *length bytes (rounded up to whole huge
+ * pages), or return NULL */
+
+char *map_huge_region( size_t *length ){
+  size_t len = ( *length + HUGE_PAGE_SIZE - 1 ) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+  char *p, *aligned;
+
+  p = (char *) mmap( NULL, len, PROT_READ | PROT_WRITE,
+    MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0 );
+  if( p != MAP_FAILED ){
+    region_backing = "MAP_HUGETLB";
+    *length = len;
+    return p;
+  }
+
+  // Over-map by one huge page and trim to a 2 MiB boundary
+  p = (char *) mmap( NULL, len + HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE,
+    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 );
+  if( p == MAP_FAILED ) return NULL;
+  aligned = (char *) ( ( (uintptr_t) p + HUGE_PAGE_SIZE - 1 ) & ~(uintptr_t) ( HUGE_PAGE_SIZE - 1 ) );
+  if( aligned > p ) munmap( p, aligned - p );
+  munmap( aligned + len, p + HUGE_PAGE_SIZE - aligned );
+
+  if( madvise( aligned, len, MADV_HUGEPAGE ) == 0 )
+    region_backing = "madvise(MADV_HUGEPAGE)";
+  else
+    region_backing = "small pages (MADV_HUGEPAGE refused)";
+  *length = len;
+  return aligned;
+}
+
+/* return 1 if allocating "req" bytes from the free block of entry i, in
+ * the way alloc_mem() does, would break into a huge page that lies
+ * wholly inside the free block */
+
+int breaks_huge_page( unsigned int i, unsigned int req ){
+  unsigned long b0 = fi_offset[i] - 16, b1 = fi_offset[i] + fi_size[i] + 16;
+  unsigned long a0, page;
+
+  // a split takes the bottom of the block, otherwise all of it goes
+  a0 = ( fi_size[i] >= req + 48 ) ? b1 - req - 32 : b0;
+  for( page = a0 / HUGE_PAGE_SIZE; page * HUGE_PAGE_SIZE < b1; page++ ){
+    if( page * HUGE_PAGE_SIZE >= b0 && ( page + 1 ) * HUGE_PAGE_SIZE <= b1 )
+      return 1;
+  }
+  return 0;
+}
+
+/* first fit that keeps whole free huge pages intact when it can */
+
+int fi_search_huge( unsigned int size ){
+  int i, first = -1;
+
+  for( i = fi_count - 1; i >= 0; i-- ){
+    if( fi_size[i] < size ) continue;
+    if( !breaks_huge_page( i, size ) ){ fi_scanned = fi_count - i; return i; }
+    if( first < 0 ) first = i;
+  }
+  fi_scanned = fi_count;
+  return first;
+}
+
+/* reserve-then-commit backing
+ *
+ * Allocations are taken from the bottom of a free block, so the used
+ * part of a fresh region grows downward from its end. In REGION_RESERVE
+ * mode only the first page (the "end_region" tag and the top tag and
+ * links of the initial free block) and the pages from commit_low to the
+ * end of the region are committed; the range in between stays
+ * PROT_NONE. Before alloc_mem() or alloc_mem_aligned() write below
+ * commit_low, commit_region() maps that range read/write with
+ * MAP_POPULATE, in steps of at least COMMIT_STEP bytes, so the pages
+ * are in place before the caller touches them. The boundaries of the
+ * region never move, and released memory stays committed.
+ *
+ * prefault_region() commits the whole region and populates it with a
+ * number of threads, for callers that cannot take a page fault on the
+ * first touch of a block.
+ */
+
+char *commit_low, *commit_floor;
+size_t page_size;
+
+/* commit the pages from "lo" up to commit_low */
+
+void commit_region( char *lo ){
+  char *new_low;
+
+  if( lo >= commit_low ) return;
+  new_low = (char *) ( (uintptr_t) lo & ~(uintptr_t) ( page_size - 1 ) );
+  if( commit_low - new_low < COMMIT_STEP ) new_low = commit_low - COMMIT_STEP;
+  if( new_low < commit_floor ) new_low = commit_floor;
+  if( new_low >= commit_low ) return;
+
+  if( mmap( new_low, commit_low - new_low, PROT_READ | PROT_WRITE,
+      MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED | MAP_POPULATE, -1, 0 ) == MAP_FAILED
+      && mprotect( new_low, commit_low - new_low, PROT_READ | PROT_WRITE ) != 0 ){
+    printf( "cannot commit region memory!\n" ); exit(0);
+  }
+  commit_low = new_low;
+}
+
+/* return the number of bytes of the region that are committed */
+
+size_t region_committed(){
+  if( region_mode != REGION_RESERVE ) return region_length;
+  return ( commit_floor - region_base ) + ( region_base + region_length - commit_low );
+}
+
+/* reserve a PROT_NONE range for a region of *length bytes (rounded up
+ * to whole pages) and commit its first and last pages, or return NULL */
+
+char *map_reserved_region( size_t *length, unsigned int size ){
+  size_t len = ( *length + page_size - 1 ) / page_size * page_size;
+  char *p;
+
+  p = (char *) mmap( NULL, len, PROT_NONE,
+    MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0 );
+  if( p == MAP_FAILED ) return NULL;
+  *length = len;
+
+  // the first page holds the top tag and links of the initial block,
+  // and the end of the region holds its ending tag and the list header
+  commit_floor = p;
+  commit_low = p + len;
+  commit_region( p + size + 32 );
+  if( commit_low > p ){
+    commit_floor = p + page_size;
+    if( mprotect( p, page_size, PROT_READ | PROT_WRITE ) != 0 ){
+      munmap( p, len );
+      return NULL;
+    }
+  }
+  region_backing = "reserved range (PROT_NONE)";
+  return p;
+}
+
+struct prefault_slice { char *start; size_t length; };
+
+void *prefault_thread( void *arg ){
+  struct prefault_slice *slice = (struct prefault_slice *) arg;
+  volatile char *p;
+
+#ifdef MADV_POPULATE_WRITE
+  if( madvise( slice->start, slice->length, MADV_POPULATE_WRITE ) == 0 ) return NULL;
+#endif
+  // rewrite one byte per page with its own value; the heap is not in use
+  for( p = slice->start; p < slice->start + slice->length; p += page_size ) *p = *p;
+  return NULL;
+}
+
+/* void prefault_region( int threads )
+ *
+ *   commits the rest of a reserved region (without populating it) and
+ *   populates every page of the region, splitting it into one slice per
+ *   thread; must be called before the region is shared with other
+ *   threads
+ */
+
+void prefault_region( int threads ){
+  struct prefault_slice slice[64];
+  pthread_t tid[64];
+  int started[64];
+  size_t pages = region_length / page_size, per;
+  int t, n;
+
+  // commit the rest without populating it, so that the threads below
+  // take the page faults in parallel instead of the caller alone
+  if( region_mode == REGION_RESERVE && commit_low > commit_floor ){
+    if( mprotect( commit_floor, commit_low - commit_floor, PROT_READ | PROT_WRITE ) != 0 ){
+      printf( "cannot commit region memory!\n" ); exit(0);
+    }
+    commit_low = commit_floor;
+  }
+  if( threads < 1 ) threads = 1;
+  if( threads > 64 ) threads = 64;
+  per = ( pages + threads - 1 ) / threads;
+
+  for( n = 0; n < threads && (size_t) n * per < pages; n++ ){
+    slice[n].start = region_base + (size_t) n * per * page_size;
+    slice[n].length = ( ( (size_t) n + 1 ) * per <= pages ? per : pages - (size_t) n * per ) * page_size;
+  }
+  // slice 0 is done by the calling thread, and a slice whose thread
+  // cannot be started is done by the caller too
+  for( t = 1; t < n; t++ )
+    started[t] = ( pthread_create( &tid[t], NULL, prefault_thread, &slice[t] ) == 0 );
+  prefault_thread( &slice[0] );
+  for( t = 1; t < n; t++ ){
+    if( started[t] ) pthread_join( tid[t], NULL );
+    else prefault_thread( &slice[t] );
+  }
+}
+
+/* allocation engines
+ *
+ *   alloc_mem(), release_mem(), free_size() and prt_free_list() run the
+ *   boundary-tag engine of this file unless the region was built with
+ *   REGION_BUDDY; then init_region_mode() points engine_alloc and the
+ *   others at the buddy engine and the four calls go there instead.
+ *   buddy_alloc.c supplies that engine when it is compiled with
+ *   -DBUDDY_ENGINE and linked in; its functions are declared weak here,
+ *   so alloc.c still links by itself, and without them REGION_BUDDY
+ *   falls back to malloc() backing and boundary tags like the other
+ *   modes do when their backing is unavailable.
+ *
+ *   Only the four calls above know about the buddy engine. On a buddy
+ *   region alloc_mem_near() and alloc_mem_life() ignore their hints,
+ *   alloc_mem_aligned() serves alignments of at most 16, and the
+ *   routines that walk the tags (the statistics, the profiler, the
+ *   fragmentation dump, the verifier, the rings and the tiny tier) must
+ *   not be used.
+ */
+
+void buddy_init( char *base, unsigned int size ) __attribute__ ((weak));
+void *buddy_alloc( unsigned int amount ) __attribute__ ((weak));
+unsigned int buddy_release( void *ptr ) __attribute__ ((weak));
+int buddy_free_size() __attribute__ ((weak));
+void buddy_prt_free_list() __attribute__ ((weak));
+
+void *(*engine_alloc)( unsigned int amount );
+unsigned int (*engine_release)( void *ptr );
+int (*engine_free_size)();
+void (*engine_prt_free_list)();
+
+/* void init_region_mode( unsigned int size, int mode )
+ *
+ *   builds the region described above around a single free block of
+ *   "size" bytes (rounded up to a multiple of 16); the region takes
+ *   80 bytes more than that for the four tag blocks and the free list
+ *   header node; "mode" selects the backing as described above, and in
+ *   REGION_HUGEPAGE mode the free block grows to fill the last huge page;
+ *   in REGION_RESERVE mode "size" is the most the heap can ever hold;
+ *   in REGION_BUDDY mode the region is just the "size" bytes for the
+ *   buddy engine
+ *
+ * void init_region_size( unsigned int size )
+ *
+ *   the same with REGION_MALLOC backing
+ *
+ * void release_region()
+ *
+ *   gives the memory of the region back to the system
+ */
+
+void init_region_mode( unsigned int size, int mode ){
   struct tag_block *ptr;
   struct free_block *links1, *links2;
 
-  region_base = (char *) malloc( 1680 );
+  size = ( ( size + 15 ) / 16 ) * 16;
+
+  region_mode = REGION_MALLOC;
+  region_backing = "malloc";
+  region_length = (size_t) size + 80;
+  region_base = NULL;
+  engine_alloc = NULL;
+  engine_release = NULL;
+  engine_free_size = NULL;
+  engine_prt_free_list = NULL;
+  if( page_size == 0 ) page_size = sysconf( _SC_PAGESIZE );
+  if( mode == REGION_BUDDY ){
+    if( buddy_init != NULL ){
+      region_length = size;
+      region_base = (char *) malloc( region_length );
+      if( region_base == NULL ){ printf( "no memory!\n" ); exit(0); }
+      buddy_init( region_base, size );
+      region_mode = REGION_BUDDY;
+      region_backing = "buddy";
+      engine_alloc = buddy_alloc;
+      engine_release = buddy_release;
+      engine_free_size = buddy_free_size;
+      engine_prt_free_list = buddy_prt_free_list;
+      printf( "data structure starts at %p\n", region_base );
+      printf( "buddy engine manages %u bytes\n", size );
+      return;
+    }
+    printf( "buddy engine unavailable, using boundary tags\n" );
+  }
+  if( mode == REGION_RESERVE ){
+    region_base = map_reserved_region( &region_length, size );
+    if( region_base != NULL ) region_mode = REGION_RESERVE;
+    else printf( "reserved region unavailable, using malloc\n" );
+  }
+  if( mode == REGION_HUGEPAGE ){
+    region_base = map_huge_region( &region_length );
+    if( region_base != NULL ){
+      region_mode = REGION_HUGEPAGE;
+      size = region_length - 80;
+    }else{
+      printf( "huge page region unavailable, using malloc\n" );
+    }
+  }
+  if( region_base == NULL ) region_base = (char *) malloc( region_length );
   if( region_base == NULL ){ printf( "no memory!\n" ); exit(0); }
 
   ptr = (struct tag_block *) region_base;
@@ -184,57 +741,1967 @@ void init_region(){
   ptr = (struct tag_block *)(region_base + 16);
   ptr->tag = 0;
   strcpy( ptr->sig, "top_memblk" );
-  ptr->size = 1600;
+  ptr->size = size;
 
-  ptr = (struct tag_block *)(region_base + 1632);
+  ptr = (struct tag_block *)(region_base + size + 32);
   ptr->tag = 0;
   strcpy( ptr->sig, "end_memblk" );
-  ptr->size = 1600;
+  ptr->size = size;
 
-  ptr = (struct tag_block *)(region_base + 1648);
+  ptr = (struct tag_block *)(region_base + size + 48);
+  region_top = ptr;
   ptr->tag = 1;
   strcpy( ptr->sig, "top_region" );
   ptr->size = 0;
 
   links1 = (struct free_block *)(region_base + 32);
-  links2 = (struct free_block *)(region_base + 1664);
+  links2 = (struct free_block *)(region_base + size + 64);
   links1->back_link = links2;
   links1->fwd_link = links2;
   links2->back_link = links1;
   links2->fwd_link = links1;
 
-  free_list = links2;
+  free_list = links2;
+
+  fi_reset();
+  fi_insert( links1, size );
+
+  printf( "data structure starts at %p\n", region_base );
+  printf( "free_list is located at %p\n", free_list);
+}
+
+void init_region_size( unsigned int size ){
+  init_region_mode( size, REGION_MALLOC );
+}
+
+void release_region(){
+  if( region_mode == REGION_MALLOC || region_mode == REGION_BUDDY ) free( region_base );
+  else munmap( region_base, region_length );
+  region_base = NULL;
+  engine_alloc = NULL;
+  engine_release = NULL;
+  engine_free_size = NULL;
+  engine_prt_free_list = NULL;
+  tiny_reset();
+}
+
+/* print how much of the region is resident, and how much of that is in
+ * huge pages, from the region's entries in /proc/self/smaps (a reserved
+ * region may be split over several mappings) */
+
+void prt_huge_coverage(){
+  FILE *fp = fopen( "/proc/self/smaps", "r" );
+  char line[256];
+  unsigned long start, end, kb;
+  unsigned long rss = 0, thp = 0, hugetlb = 0;
+  int in_region = 0;
+
+  if( fp == NULL ){ printf( "   huge page coverage not available\n" ); return; }
+  while( fgets( line, sizeof( line ), fp ) != NULL ){
+    if( sscanf( line, "%lx-%lx ", &start, &end ) == 2 ){
+      // a mapping line; the field lines that follow belong to it
+      in_region = ( start < (uintptr_t) region_base + region_length && end > (uintptr_t) region_base );
+    }else if( in_region ){
+      if( sscanf( line, "Rss: %lu kB", &kb ) == 1 ) rss += kb;
+      else if( sscanf( line, "AnonHugePages: %lu kB", &kb ) == 1 ) thp += kb;
+      else if( sscanf( line, "Private_Hugetlb: %lu kB", &kb ) == 1 ) hugetlb += kb;
+    }
+  }
+  fclose( fp );
+  printf( "   region backed by %s: %lu kB resident, %lu kB in transparent huge pages, %lu kB hugetlb\n",
+    region_backing, rss, thp, hugetlb );
+}
+
+void init_region(){
+  init_region_size( 1600 );
+}
+
+void prt_free_block( struct free_block *fb ){
+  struct tag_block *tb = (struct tag_block *)((char *)(fb) - 16);
+  printf( "   free block at %p of size 0x%x\n", (char *)fb, tb->size );
+  TOPSIGCHK(tb,"prt_free_block")
+  ENDSIGCHK((char *)(tb)+(tb->size)+16,"prt_free_block")
+}
+
+void prt_free_list(){
+  struct free_block *ptr;
+  if( engine_prt_free_list != NULL ){ engine_prt_free_list(); return; }
+  if( free_list->fwd_link == free_list ){
+    printf( "   ----------free list is empty-----------\n" );
+    return;
+  }
+  printf( "   ---------------free list---------------\n" );
+  ptr = free_list->fwd_link;
+  prt_free_block( ptr );
+  ptr = ptr->fwd_link;
+  while( ptr != free_list ){
+    prt_free_block( ptr );
+    ptr = ptr->fwd_link;
+  }
+  printf( "   --------------end of list--------------\n" );
+}
+
+
+
+/* allocation statistics
+ *
+ * alloc_mem() and release_mem() keep running counts in alloc_stats:
+ *
+ *   allocs, failed       calls with a nonzero amount, and those of them
+ *                        that returned NULL
+ *   scanned              free block entries examined by the fit search
+ *                        in all calls (the search reads the index, whose
+ *                        entries are the free list nodes in list order,
+ *                        plus dead entries not yet compacted), with
+ *                        max_scanned and a histogram of entries per
+ *                        call: bucket k counts 2^(k-1) < n <= 2^k
+ *   splits, whole        allocations that split a free block, and those
+ *                        that took a whole block because fewer than 48
+ *                        bytes would have been left
+ *   size_hist[k]         allocations whose rounded size is at most
+ *                        16 << k bytes (the last bucket takes the rest)
+ *   round_waste          bytes added by rounding requests up to 16
+ *   whole_waste          bytes granted beyond the rounded size by whole
+ *                        block allocations
+ *   releases             calls, and release_case[0..3] the valid ones by
+ *                        coalescing case; the rest were rejected
+ *
+ * alloc_mem_aligned() and the tiny tier are not counted, except for
+ * the release_mem() calls they make. get_alloc_stats() copies the
+ * counts, reset_alloc_stats() clears them, and prt_alloc_stats() prints
+ * them in the manner of prt_free_list().
+ */
+
+#define STAT_DEPTHS 24
+#define STAT_SIZES 20
+
+struct alloc_stats {
+  unsigned long allocs, failed;
+  unsigned long scanned, max_scanned, depth_hist[STAT_DEPTHS];
+  unsigned long splits, whole;
+  unsigned long size_hist[STAT_SIZES];
+  unsigned long round_waste, whole_waste;
+  unsigned long releases, release_case[4];
+};
+
+struct alloc_stats alloc_stats;
+
+void get_alloc_stats( struct alloc_stats *out ){
+  *out = alloc_stats;
+}
+
+void reset_alloc_stats(){
+  memset( &alloc_stats, 0, sizeof( alloc_stats ) );
+}
+
+/* record a fit search of n entries and a request rounded to req bytes */
+
+void stat_search( unsigned int n, unsigned int req ){
+  unsigned int k = ( n <= 1 ) ? 0 : 64 - __builtin_clzll( n - 1 );
+  unsigned int c = ( req <= 16 ) ? 0 : 64 - __builtin_clzll( ( req - 1 ) / 16 );
+
+  alloc_stats.allocs++;
+  alloc_stats.scanned += n;
+  if( n > alloc_stats.max_scanned ) alloc_stats.max_scanned = n;
+  alloc_stats.depth_hist[k < STAT_DEPTHS ? k : STAT_DEPTHS - 1]++;
+  alloc_stats.size_hist[c < STAT_SIZES ? c : STAT_SIZES - 1]++;
+}
+
+void prt_alloc_stats(){
+  struct alloc_stats *st = &alloc_stats;
+  unsigned int k;
+
+  printf( "   ---------------alloc stats-------------\n" );
+  printf( "   alloc_mem %lu calls, %lu failed, %lu splits, %lu whole blocks\n",
+    st->allocs, st->failed, st->splits, st->whole );
+  printf( "   entries scanned %lu, %.1f per call, at most %lu\n", st->scanned,
+    st->allocs ? (double) st->scanned / st->allocs : 0.0, st->max_scanned );
+  for( k = 0; k < STAT_DEPTHS; k++ )
+    if( st->depth_hist[k] ) printf( "      scanned <= %-8lu %lu\n", 1UL << k, st->depth_hist[k] );
+  for( k = 0; k < STAT_SIZES; k++ )
+    if( st->size_hist[k] ) printf( "      size <= 0x%-8lx %lu\n", 16UL << k, st->size_hist[k] );
+  printf( "   internal fragmentation %lu bytes from rounding, %lu from whole blocks\n",
+    st->round_waste, st->whole_waste );
+  printf( "   release_mem %lu calls, %lu rejected, cases 1-4: %lu %lu %lu %lu\n",
+    st->releases, st->releases - st->release_case[0] - st->release_case[1]
+    - st->release_case[2] - st->release_case[3], st->release_case[0], st->release_case[1],
+    st->release_case[2], st->release_case[3] );
+  printf( "   --------------end of stats-------------\n" );
+}
+
+
+/* sampling heap profiler
+ *
+ * alloc_mem() counts the rounded bytes it hands out down from
+ * prof_countdown, and only when that goes below zero does it call
+ * prof_record(), so an allocation that is not sampled costs one
+ * subtraction and one test. The distance to the next sample is drawn
+ * from an exponential distribution with a mean of prof_rate bytes, so
+ * the samples are a byte-weighted Poisson process: a block of s bytes
+ * is sampled with probability 1 - exp(-s/prof_rate), independent of
+ * the sizes around it.
+ *
+ * prof_record() captures the call stack with backtrace(), counts the
+ * allocation in a bucket for that stack, and keeps the block in a hash
+ * of live samples. The ending tag of a sampled block gets the
+ * signature "end_sampld" instead of "end_alcblk", so release_mem()
+ * looks in that hash (prof_forget()) only for blocks that were sampled.
+ *
+ * prof_start( rate ) starts sampling with the given mean interval (0
+ * stops it), and prof_dump( fp ) writes the buckets as a heap profile
+ * in the legacy text format read by pprof, which scales the sampled
+ * counts back up with the rate:
+ *
+ *   heap profile: <live>: <live bytes> [<allocs>: <alloc bytes>] @ heap_v2/<rate>
+ *   <live>: <live bytes> [<allocs>: <alloc bytes>] @ <pc> <pc> ...
+ *   ...
+ *   MAPPED_LIBRARIES:
+ *   <contents of /proc/self/maps>
+ */
+
+#include <execinfo.h>
+#include <limits.h>
+
+#define PROF_DEPTH 32
+#define PROF_TABLE 1024
+
+struct prof_bucket {
+  struct prof_bucket *next;
+  unsigned long hash;
+  int depth;
+  void *stack[PROF_DEPTH];
+  unsigned long allocs, alloc_bytes, frees, free_bytes;
+};
+
+struct prof_sample {
+  struct prof_sample *next;
+  void *ptr;
+  unsigned int size;
+  struct prof_bucket *bucket;
+};
+
+long prof_countdown = LONG_MAX;
+unsigned long prof_rate = 0;
+uint64_t prof_seed = 88172645463325252ULL;
+struct prof_bucket *prof_buckets[PROF_TABLE];
+struct prof_sample *prof_live[PROF_TABLE];
+
+#define PROF_HASH(p) ((((uintptr_t)(p)) >> 4) % PROF_TABLE)
+
+/* bytes to the next sample: -ln(u) * prof_rate for u uniform in (0,1],
+ * with log2 of the 32-bit u taken from its exponent and a quadratic in
+ * its mantissa (good to about 1%) */
+
+long prof_interval(){
+  uint64_t q;
+  unsigned int e;
+  double m, log2_q;
+
+  prof_seed ^= prof_seed << 13;
+  prof_seed ^= prof_seed >> 7;
+  prof_seed ^= prof_seed << 17;
+  q = ( prof_seed >> 32 ) + 1;
+  e = 63 - __builtin_clzll( q );
+  m = (double) q / (double) ( 1ULL << e ) - 1.0;
+  log2_q = e + m * ( 1.3465 - 0.3465 * m );
+  return (long) ( ( 32.0 - log2_q ) * 0.693147 * prof_rate ) + 1;
+}
+
+void prof_start( unsigned long rate ){
+  prof_rate = rate;
+  prof_countdown = rate ? prof_interval() : LONG_MAX;
+}
+
+__attribute__ ((noinline))
+void prof_record( void *ptr, unsigned int amount ){
+  struct tag_block *tag_ptr = (struct tag_block *) ptr - 1;
+  struct tag_block *end_ptr = tag_ptr + ( tag_ptr->size / 16 ) + 1;
+  struct prof_bucket *b;
+  struct prof_sample *smp;
+  void *stack[PROF_DEPTH + 1];
+  unsigned long hash = 0;
+  int depth, i;
+
+  if( prof_rate == 0 ){ prof_countdown = LONG_MAX; return; }
+  prof_countdown = prof_interval();
+
+  // drop the frame of prof_record() itself
+  depth = backtrace( stack, PROF_DEPTH + 1 ) - 1;
+  for( i = 0; i < depth; i++ ) hash = ( hash + (uintptr_t) stack[i + 1] ) * 0x9e3779b97f4a7c15ULL;
+
+  for( b = prof_buckets[hash % PROF_TABLE]; b != NULL; b = b->next )
+    if( b->hash == hash && b->depth == depth
+        && memcmp( b->stack, stack + 1, depth * sizeof( void * ) ) == 0 ) break;
+  if( b == NULL ){
+    b = (struct prof_bucket *) calloc( 1, sizeof( struct prof_bucket ) );
+    smp = (struct prof_sample *) malloc( sizeof( struct prof_sample ) );
+    if( b == NULL || smp == NULL ){ free( b ); free( smp ); return; }
+    b->hash = hash;
+    b->depth = depth;
+    memcpy( b->stack, stack + 1, depth * sizeof( void * ) );
+    b->next = prof_buckets[hash % PROF_TABLE];
+    prof_buckets[hash % PROF_TABLE] = b;
+  }else{
+    smp = (struct prof_sample *) malloc( sizeof( struct prof_sample ) );
+    if( smp == NULL ) return;
+  }
+  b->allocs++;
+  b->alloc_bytes += amount;
+
+  smp->ptr = ptr;
+  smp->size = amount;
+  smp->bucket = b;
+  smp->next = prof_live[PROF_HASH(ptr)];
+  prof_live[PROF_HASH(ptr)] = smp;
+  strcpy( end_ptr->sig, "end_sampld" );
+}
+
+void prof_forget( void *ptr ){
+  struct prof_sample **link, *smp;
+
+  for( link = &prof_live[PROF_HASH(ptr)]; ( smp = *link ) != NULL; link = &smp->next ){
+    if( smp->ptr != ptr ) continue;
+    *link = smp->next;
+    smp->bucket->frees++;
+    smp->bucket->free_bytes += smp->size;
+    free( smp );
+    return;
+  }
+}
+
+void prof_dump( FILE *fp ){
+  unsigned long live = 0, live_bytes = 0, allocs = 0, alloc_bytes = 0;
+  struct prof_bucket *b;
+  FILE *maps;
+  char line[512];
+  unsigned int h;
+  int i;
+
+  for( h = 0; h < PROF_TABLE; h++ ){
+    for( b = prof_buckets[h]; b != NULL; b = b->next ){
+      live += b->allocs - b->frees;
+      live_bytes += b->alloc_bytes - b->free_bytes;
+      allocs += b->allocs;
+      alloc_bytes += b->alloc_bytes;
+    }
+  }
+  fprintf( fp, "heap profile: %lu: %lu [%lu: %lu] @ heap_v2/%lu\n",
+    live, live_bytes, allocs, alloc_bytes, prof_rate );
+  for( h = 0; h < PROF_TABLE; h++ ){
+    for( b = prof_buckets[h]; b != NULL; b = b->next ){
+      fprintf( fp, "%lu: %lu [%lu: %lu] @", b->allocs - b->frees,
+        b->alloc_bytes - b->free_bytes, b->allocs, b->alloc_bytes );
+      for( i = 0; i < b->depth; i++ ) fprintf( fp, " %p", b->stack[i] );
+      fprintf( fp, "\n" );
+    }
+  }
+
+  fprintf( fp, "\nMAPPED_LIBRARIES:\n" );
+  maps = fopen( "/proc/self/maps", "r" );
+  if( maps == NULL ) return;
+  while( fgets( line, sizeof( line ), maps ) != NULL ) fputs( line, fp );
+  fclose( maps );
+}
+
+
+/* fragmentation map dump
+ *
+ * frag_dump( fp ) appends a snapshot of the whole region to a binary
+ * file: a header followed by one record per block, found by walking the
+ * boundary tags from the block below the "end_region" tag at the start
+ * of the region to the "top_region" tag at its end. Free and allocated
+ * blocks are both recorded, so a snapshot holds the full layout even
+ * for a heap of millions of blocks, at 8 bytes per block:
+ *
+ *   header  magic "fragmap1"   8 bytes
+ *           sequence           4 bytes, counts snapshots from 0
+ *           blocks             4 bytes, number of records that follow
+ *           region bytes       8 bytes, from the first tag of the first
+ *                              block to the "top_region" tag
+ *   record  offset             4 bytes, of the block's top tag from the
+ *                              first block (a multiple of 16)
+ *           size and state     4 bytes, the payload size from the tag
+ *                              (a multiple of 16) plus 1 if allocated
+ *
+ * All fields are little-endian as written by this program. The records
+ * are in address order, and a block spans its offset to offset + size
+ * + 32 (the two tags). frag_analyze.c reads these files.
+ *
+ * The tags are walked twice, once to count the blocks for the header
+ * and once to write the records, so the file is written strictly in
+ * order and may be a pipe.
+ */
+
+struct frag_header { char magic[8]; uint32_t sequence, blocks; uint64_t region_bytes; };
+struct frag_record { uint32_t offset, size_state; };
+
+uint32_t frag_sequence = 0;
+
+void frag_dump( FILE *fp ){
+  struct frag_header hdr;
+  struct frag_record rec[256];
+  struct tag_block *first = (struct tag_block *) ( region_base + 16 ), *tb;
+  unsigned int n = 0, blocks = 0;
+
+  // count the blocks first so the header goes out complete
+  for( tb = first; strncmp( tb->sig, "top_region", 10 ) != 0; tb += ( tb->size / 16 ) + 2 ) blocks++;
+
+  memcpy( hdr.magic, "fragmap1", 8 );
+  hdr.sequence = frag_sequence++;
+  hdr.blocks = blocks;
+  hdr.region_bytes = (char *) tb - (char *) first;
+  fwrite( &hdr, sizeof( hdr ), 1, fp );
+
+  for( tb = first; strncmp( tb->sig, "top_region", 10 ) != 0; tb += ( tb->size / 16 ) + 2 ){
+    rec[n].offset = (char *) tb - (char *) first;
+    rec[n].size_state = tb->size | ( tb->tag == 1 );
+    if( ++n == 256 ){
+      fwrite( rec, sizeof( rec[0] ), n, fp );
+      n = 0;
+    }
+  }
+  fwrite( rec, sizeof( rec[0] ), n, fp );
+}
+
+
+/* heap verifier
+ *
+ * verify_heap( threads ) checks the whole region and returns the number
+ * of problems found, printing the first ones:
+ *
+ *   - every block, found by walking the boundary tags from the first
+ *     block to region_top, has a top tag whose signature matches its
+ *     state ("top_memblk" free, "top_alcblk" allocated, "top_pendng"
+ *     queued by release_mem_async()), a size that is a nonzero
+ *     multiple of 16 and stays inside the region, and an
+ *     ending tag with an "end_" signature and the same tag and size
+ *   - no free block is directly followed by another free block
+ *   - every free block is linked in both directions and has an index
+ *     entry of its size
+ *   - walking the free list from the header finds exactly as many
+ *     nodes, and bytes, as the free blocks found by the tag walk, and
+ *     every node is a free block
+ *
+ * The walk is split across threads at block boundaries without a
+ * sequential pass: the index gives the offsets of all free blocks, so
+ * the slice of thread t starts at the first free block at or past t/n
+ * of the region, and ends where the next slice starts. A region with no
+ * free blocks in some stretch simply has fewer, longer slices.
+ *
+ * verify_incremental( blocks ) makes each alloc_mem() call check the
+ * next "blocks" blocks of the region with the per-block tests above
+ * (0 turns this off), resuming from the block where the previous call
+ * stopped. The heap changes between calls, so if that block was merged
+ * away (its top tag no longer has a "top_" signature) the next call
+ * starts over from the first block. The free list count is only
+ * checked by verify_heap().
+ */
+
+#define VERIFY_MAX_THREADS 64
+#define VERIFY_MSG 96
+
+struct verify_slice {
+  struct tag_block *start, *stop;
+  unsigned long blocks, free_blocks, free_bytes, errors;
+  char msg[4][VERIFY_MSG];
+};
+
+unsigned int verify_budget = 0;
+struct tag_block *verify_cursor = NULL;
+unsigned long verify_passes = 0, verify_errors = 0;
+
+/* check one block; return the next block's top tag, or NULL if the
+ * walk cannot go on, and describe a problem in msg (or leave it empty) */
+
+struct tag_block *verify_block( struct tag_block *tb, char *msg ){
+  struct tag_block *end, *next;
+  struct free_block *fb;
+  int entry;
+
+  msg[0] = 0;
+  if( tb->tag != 0 && tb->tag != 1 ){
+    snprintf( msg, VERIFY_MSG, "bad tag %d at %p", tb->tag, (void *) tb );
+    return NULL;
+  }
+  if( strncmp( tb->sig, tb->tag ? "top_alcblk" : "top_memblk", 10 ) != 0
+      && ( tb->tag == 0 || strncmp( tb->sig, "top_pendng", 10 ) != 0 ) ){
+    snprintf( msg, VERIFY_MSG, "top signature %.10s for tag %d at %p", tb->sig, tb->tag, (void *) tb );
+    return NULL;
+  }
+  if( tb->size == 0 || tb->size % 16 != 0
+      || tb->size / 16 + 1 >= (unsigned long) ( region_top - tb ) ){
+    snprintf( msg, VERIFY_MSG, "bad size 0x%x at %p", tb->size, (void *) tb );
+    return NULL;
+  }
+  end = tb + ( tb->size / 16 ) + 1;
+  next = end + 1;
+  if( strncmp( end->sig, "end_", 4 ) != 0 || end->tag != tb->tag || end->size != tb->size ){
+    snprintf( msg, VERIFY_MSG, "ending tag %.10s/%d/0x%x at %p does not match top tag",
+      end->sig, end->tag, end->size, (void *) end );
+    return next;
+  }
+  if( tb->tag == 0 ){
+    fb = (struct free_block *) ( tb + 1 );
+    if( next != region_top && next->tag == 0 )
+      snprintf( msg, VERIFY_MSG, "free blocks at %p and %p are adjacent", (void *) fb, (void *) ( next + 1 ) );
+    else if( fb->fwd_link->back_link != fb || fb->back_link->fwd_link != fb )
+      snprintf( msg, VERIFY_MSG, "free block at %p is not linked both ways", (void *) fb );
+    else if( ( entry = fi_find( fb ) ) < 0 || fi_size[entry] != tb->size )
+      snprintf( msg, VERIFY_MSG, "free block at %p has no index entry of its size", (void *) fb );
+  }
+  return next;
+}
+
+void *verify_thread( void *arg ){
+  struct verify_slice *sl = (struct verify_slice *) arg;
+  struct tag_block *tb = sl->start;
+  char msg[VERIFY_MSG];
+
+  while( tb != NULL && tb < sl->stop ){
+    if( tb->tag == 0 ){
+      sl->free_blocks++;
+      sl->free_bytes += tb->size;
+    }
+    sl->blocks++;
+    tb = verify_block( tb, msg );
+    if( msg[0] != 0 ){
+      if( sl->errors < 4 ) strcpy( sl->msg[sl->errors], msg );
+      sl->errors++;
+    }
+  }
+  if( tb != NULL && tb != sl->stop ){
+    if( sl->errors < 4 ) snprintf( sl->msg[sl->errors], VERIFY_MSG, "walk passes the slice end at %p", (void *) sl->stop );
+    sl->errors++;
+  }
+  return NULL;
+}
+
+int verify_heap( int threads ){
+  struct verify_slice sl[VERIFY_MAX_THREADS];
+  pthread_t tid[VERIFY_MAX_THREADS];
+  int started[VERIFY_MAX_THREADS];
+  struct tag_block *first = (struct tag_block *) ( region_base + 16 ), *cand, *target;
+  struct free_block *ptr;
+  unsigned long span = (char *) region_top - (char *) first;
+  unsigned long blocks = 0, free_blocks = 0, free_bytes = 0, nodes = 0, node_bytes = 0, errors = 0;
+  unsigned int i;
+  int n = 0, t, k;
+
+  if( threads < 1 ) threads = 1;
+  if( threads > VERIFY_MAX_THREADS ) threads = VERIFY_MAX_THREADS;
+
+  // Slice starts: the first block, then the lowest free block past each share
+  sl[n++].start = first;
+  for( t = 1; t < threads; t++ ){
+    target = (struct tag_block *) ( (char *) first + span / threads * t );
+    cand = region_top;
+    for( i = 0; i < fi_count; i++ ){
+      struct tag_block *tb = (struct tag_block *) FI_BLOCK( fi_offset[i] ) - 1;
+      if( fi_size[i] != 0 && tb >= target && tb < cand ) cand = tb;
+    }
+    if( cand != region_top && cand > sl[n - 1].start && strncmp( cand->sig, "top_memblk", 10 ) == 0 )
+      sl[n++].start = cand;
+  }
+  for( t = 0; t < n; t++ ){
+    sl[t].stop = ( t + 1 < n ) ? sl[t + 1].start : region_top;
+    sl[t].blocks = sl[t].free_blocks = sl[t].free_bytes = sl[t].errors = 0;
+  }
+
+  for( t = 1; t < n; t++ ) started[t] = ( pthread_create( &tid[t], NULL, verify_thread, &sl[t] ) == 0 );
+  verify_thread( &sl[0] );
+  for( t = 1; t < n; t++ ){
+    if( started[t] ) pthread_join( tid[t], NULL );
+    else verify_thread( &sl[t] );
+  }
+
+  for( t = 0; t < n; t++ ){
+    blocks += sl[t].blocks;
+    free_blocks += sl[t].free_blocks;
+    free_bytes += sl[t].free_bytes;
+    for( k = 0; k < 4 && (unsigned long) k < sl[t].errors; k++ ) printf( "*** verify: %s\n", sl[t].msg[k] );
+    errors += sl[t].errors;
+  }
+
+  // The free list must hold exactly the free blocks found
+  for( ptr = free_list->fwd_link; ptr != free_list && nodes <= free_blocks; ptr = ptr->fwd_link ){
+    struct tag_block *tb = (struct tag_block *) ptr - 1;
+    if( (char *) ptr < region_base || tb >= region_top || tb->tag != 0
+        || strncmp( tb->sig, "top_memblk", 10 ) != 0 ){
+      printf( "*** verify: free list node %p is not a free block\n", (void *) ptr );
+      errors++;
+      break;
+    }
+    nodes++;
+    node_bytes += tb->size;
+  }
+  if( nodes != free_blocks || node_bytes != free_bytes ){
+    printf( "*** verify: free list has %lu%s nodes of %lu bytes, tags show %lu free blocks of %lu bytes\n",
+      nodes, ( nodes > free_blocks ) ? "+" : "", node_bytes, free_blocks, free_bytes );
+    errors++;
+  }
+
+  printf( "   verified %lu blocks (%lu free) in %d slices, %lu problems\n", blocks, free_blocks, n, errors );
+  return errors;
+}
+
+void verify_incremental( unsigned int blocks ){
+  verify_budget = blocks;
+  verify_cursor = NULL;
+}
+
+void verify_step( unsigned int blocks ){
+  struct tag_block *tb = verify_cursor;
+  char msg[VERIFY_MSG];
+
+  if( tb == NULL || strncmp( tb->sig, "top_", 4 ) != 0 ) tb = (struct tag_block *) ( region_base + 16 );
+  while( blocks-- > 0 ){
+    tb = verify_block( tb, msg );
+    if( msg[0] != 0 ){
+      printf( "*** verify: %s\n", msg );
+      verify_errors++;
+    }
+    if( tb == NULL || tb == region_top ){
+      verify_passes++;
+      tb = (struct tag_block *) ( region_base + 16 );
+    }
+  }
+  verify_cursor = tb;
+}
+
+
+/* latency histograms
+ *
+ * When compiled with -DLATENCY, alloc_mem() and release_mem() can time
+ * themselves with the processor's time stamp counter. Timing is off
+ * until lat_enable( 1 ); while it is off, the only cost in either call
+ * is the test of lat_enabled at its start. When it is on, that test
+ * sends the call to lat_alloc_mem() or lat_release_mem(), which read
+ * the counter around the untimed call (lat_inside keeps the call from
+ * coming back to them) and add the cycles to histograms of the thread:
+ *
+ *   LAT_ALLOC, LAT_RELEASE   every call
+ *   LAT_CASE1 .. LAT_CASE4   release_mem() calls by coalescing case,
+ *                            which lat_release_mem() reads from the
+ *                            neighboring tags before the call
+ *   size class c             calls for blocks of 16 << c bytes or less
+ *                            (the last class takes all larger blocks)
+ *
+ * The histograms are log-linear as in HDR histograms: values below
+ * 2^LAT_SUB_BITS cycles have a bucket each, and every power of two
+ * above that is split into 2^LAT_SUB_BITS buckets, so a bucket is at
+ * most 1/8 of its value wide. Each thread registers its histograms on
+ * its first timed call, and lat_report() merges those of all threads
+ * and prints p50, p99, p99.9 and the maximum in nanoseconds.
+ */
+
+#ifdef LATENCY
+
+#include <x86intrin.h>
+#include <time.h>
+
+#define LAT_SUB_BITS 3
+#define LAT_BUCKETS ((65 - LAT_SUB_BITS) << LAT_SUB_BITS)
+#define LAT_CLASSES 16
+
+#define LAT_ALLOC 0
+#define LAT_RELEASE 1
+#define LAT_CASE1 2
+#define LAT_OPS 6
+
+struct lat_hist { uint64_t count[LAT_BUCKETS]; uint64_t total, max; };
+
+struct lat_thread {
+  struct lat_hist op[LAT_OPS];
+  struct lat_hist size_class[2][LAT_CLASSES];
+  struct lat_thread *next;
+};
+
+int lat_enabled = 0;
+double lat_ns_per_cycle = 1.0;
+struct lat_thread *lat_threads = NULL;
+pthread_mutex_t lat_lock = PTHREAD_MUTEX_INITIALIZER;
+__thread struct lat_thread *lat_self;
+__thread int lat_inside;
+
+#define LAT_HOOK_ALLOC(amount) \
+  if(__builtin_expect(lat_enabled, 0) && !lat_inside) return lat_alloc_mem(amount);
+#define LAT_HOOK_RELEASE(ptr) \
+  if(__builtin_expect(lat_enabled, 0) && !lat_inside) return lat_release_mem(ptr);
+
+void *lat_alloc_mem( unsigned int amount );
+unsigned int lat_release_mem( void *ptr );
+
+unsigned int lat_bucket( uint64_t v ){
+  unsigned int e;
+
+  if( v < ( 1U << LAT_SUB_BITS ) ) return v;
+  e = 63 - __builtin_clzll( v );
+  return ( ( e - LAT_SUB_BITS + 1 ) << LAT_SUB_BITS )
+    + (unsigned int) ( ( v >> ( e - LAT_SUB_BITS ) ) - ( 1U << LAT_SUB_BITS ) );
+}
+
+/* the largest value that falls in bucket b */
+
+uint64_t lat_bucket_top( unsigned int b ){
+  unsigned int e;
+
+  if( b < ( 1U << LAT_SUB_BITS ) ) return b;
+  e = ( b >> LAT_SUB_BITS ) + LAT_SUB_BITS - 1;
+  return ( ( (uint64_t) ( ( 1U << LAT_SUB_BITS ) + ( b & ( ( 1U << LAT_SUB_BITS ) - 1 ) ) + 1 ) ) << ( e - LAT_SUB_BITS ) ) - 1;
+}
+
+unsigned int lat_class( unsigned int size ){
+  unsigned int c = 0;
+  while( c < LAT_CLASSES - 1 && size > ( 16U << c ) ) c++;
+  return c;
+}
+
+void lat_add( struct lat_hist *h, uint64_t cycles ){
+  h->count[lat_bucket( cycles )]++;
+  h->total++;
+  if( cycles > h->max ) h->max = cycles;
+}
+
+struct lat_thread *lat_register(){
+  struct lat_thread *t = (struct lat_thread *) calloc( 1, sizeof( struct lat_thread ) );
+
+  if( t == NULL ){ printf( "no memory!\n" ); exit(0); }
+  pthread_mutex_lock( &lat_lock );
+  t->next = lat_threads;
+  lat_threads = t;
+  pthread_mutex_unlock( &lat_lock );
+  lat_self = t;
+  return t;
+}
+
+void *lat_alloc_mem( unsigned int amount ){
+  struct lat_thread *t = lat_self ? lat_self : lat_register();
+  uint64_t t0, cycles;
+  void *ptr;
+
+  lat_inside = 1;
+  t0 = __rdtsc();
+  ptr = alloc_mem( amount );
+  cycles = __rdtsc() - t0;
+  lat_inside = 0;
+
+  lat_add( &t->op[LAT_ALLOC], cycles );
+  lat_add( &t->size_class[0][lat_class( amount )], cycles );
+  return ptr;
+}
+
+/* the coalescing case (1 to 4) release_mem() takes for a block, or 0
+ * for a pointer it rejects at the signature test or a buddy region */
+
+int lat_release_case( void *ptr ){
+  struct tag_block *tb = (struct tag_block *) ptr - 1, *end;
+
+  if( ptr == NULL || engine_release != NULL || strncmp( tb->sig, "top_alcblk", 10 ) != 0 ) return 0;
+  end = tb + 1 + tb->size / 16;
+  return 1 + ( ( tb - 1 )->tag == 0 ) + 2 * ( ( end + 1 )->tag == 0 );
+}
+
+unsigned int lat_release_mem( void *ptr ){
+  struct lat_thread *t = lat_self ? lat_self : lat_register();
+  int lat_case = lat_release_case( ptr );
+  unsigned int size = ( lat_case > 0 ) ? ( (struct tag_block *) ptr - 1 )->size : 0;
+  uint64_t t0, cycles;
+  unsigned int rc;
+
+  lat_inside = 1;
+  t0 = __rdtsc();
+  rc = release_mem( ptr );
+  cycles = __rdtsc() - t0;
+  lat_inside = 0;
+
+  if( rc != 0 ) return rc;
+  lat_add( &t->op[LAT_RELEASE], cycles );
+  if( lat_case > 0 ) lat_add( &t->op[LAT_CASE1 + lat_case - 1], cycles );
+  lat_add( &t->size_class[1][lat_class( size )], cycles );
+  return rc;
+}
+
+/* turn timing on or off; the first time it is turned on, the counter
+ * is calibrated against the monotonic clock */
+
+void lat_enable( int on ){
+  struct timespec ts0, ts1;
+  uint64_t c0, c1;
+
+  if( on && lat_ns_per_cycle == 1.0 ){
+    clock_gettime( CLOCK_MONOTONIC, &ts0 );
+    c0 = __rdtsc();
+    do clock_gettime( CLOCK_MONOTONIC, &ts1 );
+    while( ( ts1.tv_sec - ts0.tv_sec ) * 1000000000L + ( ts1.tv_nsec - ts0.tv_nsec ) < 10000000L );
+    c1 = __rdtsc();
+    lat_ns_per_cycle = ( ( ts1.tv_sec - ts0.tv_sec ) * 1e9 + ( ts1.tv_nsec - ts0.tv_nsec ) ) / ( c1 - c0 );
+  }
+  lat_enabled = on;
+}
+
+void lat_reset(){
+  struct lat_thread *t, *next;
+
+  pthread_mutex_lock( &lat_lock );
+  for( t = lat_threads; t != NULL; t = t->next ){
+    next = t->next;
+    memset( t, 0, offsetof( struct lat_thread, next ) );
+    t->next = next;
+  }
+  pthread_mutex_unlock( &lat_lock );
+}
+
+/* print one merged histogram line, if it has any calls */
+
+void lat_prt_hist( const char *name, struct lat_hist *h ){
+  uint64_t seen = 0, p50 = 0, p99 = 0, p999 = 0;
+  unsigned int b;
+
+  if( h->total == 0 ) return;
+  for( b = 0; b < LAT_BUCKETS; b++ ){
+    if( h->count[b] == 0 ) continue;
+    seen += h->count[b];
+    if( p50 == 0 && seen * 2 >= h->total ) p50 = lat_bucket_top( b );
+    if( p99 == 0 && seen * 100 >= h->total * 99 ) p99 = lat_bucket_top( b );
+    if( p999 == 0 && seen * 1000 >= h->total * 999 ) p999 = lat_bucket_top( b );
+  }
+  printf( "   %-18s %9lu calls  p50 %7.0f  p99 %7.0f  p99.9 %7.0f  max %8.0f ns\n",
+    name, (unsigned long) h->total, p50 * lat_ns_per_cycle, p99 * lat_ns_per_cycle,
+    p999 * lat_ns_per_cycle, h->max * lat_ns_per_cycle );
+}
+
+void lat_merge( struct lat_hist *into, struct lat_hist *h ){
+  unsigned int b;
+
+  for( b = 0; b < LAT_BUCKETS; b++ ) into->count[b] += h->count[b];
+  into->total += h->total;
+  if( h->max > into->max ) into->max = h->max;
+}
+
+void lat_report(){
+  static const char *op_name[LAT_OPS] = { "alloc_mem", "release_mem",
+    "  case 1", "  case 2", "  case 3", "  case 4" };
+  struct lat_thread *sum = (struct lat_thread *) calloc( 1, sizeof( struct lat_thread ) );
+  struct lat_thread *t;
+  char name[32];
+  unsigned int i, c;
+
+  if( sum == NULL ){ printf( "no memory!\n" ); exit(0); }
+  pthread_mutex_lock( &lat_lock );
+  for( t = lat_threads; t != NULL; t = t->next ){
+    for( i = 0; i < LAT_OPS; i++ ) lat_merge( &sum->op[i], &t->op[i] );
+    for( i = 0; i < 2; i++ )
+      for( c = 0; c < LAT_CLASSES; c++ ) lat_merge( &sum->size_class[i][c], &t->size_class[i][c] );
+  }
+  pthread_mutex_unlock( &lat_lock );
+
+  for( i = 0; i < LAT_OPS; i++ ) lat_prt_hist( op_name[i], &sum->op[i] );
+  for( i = 0; i < 2; i++ ){
+    for( c = 0; c < LAT_CLASSES; c++ ){
+      sprintf( name, "%s <= %u", i ? "release" : "alloc", 16U << c );
+      if( c == LAT_CLASSES - 1 ) sprintf( name, "%s > %u", i ? "release" : "alloc", 16U << ( c - 1 ) );
+      lat_prt_hist( name, &sum->size_class[i][c] );
+    }
+  }
+  free( sum );
+}
+
+#else
+
+#define LAT_HOOK_ALLOC(amount)
+#define LAT_HOOK_RELEASE(ptr)
+
+#endif
+
+
+/* blocking allocation
+ *
+ * alloc_mem_wait() lets a producer wait for memory when the heap is
+ * full instead of retrying alloc_mem() in a loop. Threads that share
+ * the heap hold heap_lock around alloc_mem() and release_mem();
+ * alloc_mem_locked() and release_mem_locked() do just that. A caller
+ * that cannot be served goes on a FIFO queue of waiters, each with the
+ * rounded size it needs. release_mem() looks at the queue only when the
+ * block it has just coalesced is at least wait_min bytes, the smallest
+ * need on the queue, which is all ones when the queue is empty. It then
+ * wakes, in queue order, the waiters that the block can serve one after
+ * another, and leaves the others parked.
+ *
+ * There are three kinds of waiter:
+ *
+ *   WAIT_THREAD    alloc_mem_wait( amount, timeout_ms ) blocks on a
+ *                  condition variable of its own, for at most
+ *                  timeout_ms milliseconds (forever if negative, not at
+ *                  all if 0); a woken waiter that finds the block taken
+ *                  by another thread goes back to the head of the queue
+ *   WAIT_CALLBACK  alloc_mem_notify( amount, fn, arg ) returns at once;
+ *                  the block is allocated for the waiter, at once or in
+ *                  release_mem() of the thread that frees the memory,
+ *                  and fn( ptr, arg ) is called with heap_lock held (fn
+ *                  may call alloc_mem() and release_mem() but not the
+ *                  _locked forms)
+ *   WAIT_EVENTFD   alloc_mem_eventfd( amount, fd ) returns at once; the
+ *                  eventfd is signaled once a block of that size is
+ *                  free, and the event loop then calls
+ *                  alloc_mem_locked(), which can still fail if another
+ *                  thread was first; alloc_mem_cancel_eventfd( fd )
+ *                  drops the waiters of an eventfd before it is closed
+ *
+ * A request larger than the whole region fails at once instead of
+ * waiting forever.
+ */
+
+#include <errno.h>
+#include <time.h>
+#include <sys/eventfd.h>
+
+#define WAIT_THREAD 0
+#define WAIT_CALLBACK 1
+#define WAIT_EVENTFD 2
+
+struct waiter {
+  struct waiter *prev, *next;
+  int kind, woken, fd;
+  unsigned int amount, need;
+  pthread_cond_t cond;
+  void (*fn)( void *ptr, void *arg );
+  void *arg;
+};
+
+pthread_mutex_t heap_lock = PTHREAD_MUTEX_INITIALIZER;
+struct waiter *wait_head, *wait_tail;
+unsigned int wait_min = 0xffffffff;
+unsigned long wait_parked, wait_woken, wait_timeouts, wait_requeued;
+
+/* the largest block the region can ever hold */
+
+unsigned int wait_capacity(){
+  return (char *) region_top - region_base - 2 * sizeof( struct tag_block );
+}
+
+void wait_link( struct waiter *w, int at_head ){
+  if( at_head ){
+    w->prev = NULL;
+    w->next = wait_head;
+    if( wait_head != NULL ) wait_head->prev = w; else wait_tail = w;
+    wait_head = w;
+  }else{
+    w->next = NULL;
+    w->prev = wait_tail;
+    if( wait_tail != NULL ) wait_tail->next = w; else wait_head = w;
+    wait_tail = w;
+  }
+  if( w->need < wait_min ) wait_min = w->need;
+}
+
+/* unlinking leaves wait_min as it was, which is still no larger than
+ * any need on the queue; callers recompute it with wait_update_min()
+ * once they are done unlinking */
+
+void wait_unlink( struct waiter *w ){
+  if( w->prev != NULL ) w->prev->next = w->next; else wait_head = w->next;
+  if( w->next != NULL ) w->next->prev = w->prev; else wait_tail = w->prev;
+}
+
+void wait_update_min(){
+  struct waiter *v;
+
+  wait_min = 0xffffffff;
+  for( v = wait_head; v != NULL; v = v->next )
+    if( v->need < wait_min ) wait_min = v->need;
+}
+
+/* called by release_mem() with heap_lock held when a free block of
+ * "size" bytes may serve a waiter */
+
+void wait_wake( unsigned int size ){
+  struct waiter *w, *next, *calls = NULL;
+  void *ptr;
+
+  for( w = wait_head; w != NULL && size >= wait_min; w = next ){
+    next = w->next;
+    if( w->need > size ) continue;
+    wait_unlink( w );
+    wait_woken++;
+    // what the block has left for the next waiter, if it is split
+    size = ( size >= w->need + 48 ) ? size - w->need - 2 * sizeof( struct tag_block ) : 0;
+    if( w->kind == WAIT_THREAD ){
+      w->woken = 1;
+      pthread_cond_signal( &w->cond );
+    }else if( w->kind == WAIT_EVENTFD ){
+      eventfd_write( w->fd, 1 );
+      free( w );
+    }else{
+      w->next = calls;
+      calls = w;
+    }
+  }
+  wait_update_min();
+  // callbacks allocate only after the queue walk is done
+  while( calls != NULL ){
+    w = calls;
+    calls = w->next;
+    ptr = alloc_mem( w->amount );
+    if( ptr == NULL ){
+      wait_requeued++;
+      wait_link( w, 1 );
+      continue;
+    }
+    w->fn( ptr, w->arg );
+    free( w );
+  }
+}
+
+void *alloc_mem_locked( unsigned int amount ){
+  void *ptr;
+
+  pthread_mutex_lock( &heap_lock );
+  ptr = alloc_mem( amount );
+  pthread_mutex_unlock( &heap_lock );
+  return ptr;
+}
+
+unsigned int release_mem_locked( void *ptr ){
+  unsigned int rc;
+
+  pthread_mutex_lock( &heap_lock );
+  rc = release_mem( ptr );
+  pthread_mutex_unlock( &heap_lock );
+  return rc;
+}
+
+/* void *alloc_mem_wait( unsigned int amount, int timeout_ms )
+ *
+ * alloc_mem() that waits up to timeout_ms milliseconds (forever if
+ * negative) for memory to be released; returns NULL on a timeout */
+
+void *alloc_mem_wait( unsigned int amount, int timeout_ms ){
+  struct waiter w;
+  struct timespec deadline;
+  pthread_condattr_t attr;
+  void *ptr;
+  int rc;
+
+  if( amount == 0 || amount > wait_capacity() ) return NULL;
+  pthread_mutex_lock( &heap_lock );
+  ptr = alloc_mem( amount );
+  if( ptr != NULL || timeout_ms == 0 ){
+    pthread_mutex_unlock( &heap_lock );
+    return ptr;
+  }
+
+  clock_gettime( CLOCK_MONOTONIC, &deadline );
+  deadline.tv_sec += timeout_ms / 1000;
+  deadline.tv_nsec += ( timeout_ms % 1000 ) * 1000000L;
+  if( deadline.tv_nsec >= 1000000000L ){
+    deadline.tv_sec++;
+    deadline.tv_nsec -= 1000000000L;
+  }
+  pthread_condattr_init( &attr );
+  pthread_condattr_setclock( &attr, CLOCK_MONOTONIC );
+  pthread_cond_init( &w.cond, &attr );
+  pthread_condattr_destroy( &attr );
+
+  w.kind = WAIT_THREAD;
+  w.woken = 0;
+  w.amount = amount;
+  w.need = ( amount + 15 ) & ~15U;
+  wait_link( &w, 0 );
+  wait_parked++;
+  for( ;; ){
+    if( timeout_ms < 0 ) rc = pthread_cond_wait( &w.cond, &heap_lock );
+    else rc = pthread_cond_timedwait( &w.cond, &heap_lock, &deadline );
+    if( w.woken ){
+      w.woken = 0;
+      ptr = alloc_mem( amount );
+      if( ptr != NULL ) break;
+      wait_requeued++;
+      wait_link( &w, 1 );
+    }
+    if( rc == ETIMEDOUT ){
+      wait_unlink( &w );
+      wait_update_min();
+      wait_timeouts++;
+      break;
+    }
+  }
+  pthread_cond_destroy( &w.cond );
+  pthread_mutex_unlock( &heap_lock );
+  return ptr;
+}
+
+/* park a waiter of the given kind, or return 1 if there is no memory
+ * for it */
+
+int wait_park( int kind, unsigned int amount, int fd, void (*fn)( void *, void * ), void *arg ){
+  struct waiter *w = (struct waiter *) malloc( sizeof( struct waiter ) );
+
+  if( w == NULL ) return 1;
+  w->kind = kind;
+  w->woken = 0;
+  w->fd = fd;
+  w->amount = amount;
+  w->need = ( amount + 15 ) & ~15U;
+  w->fn = fn;
+  w->arg = arg;
+  wait_link( w, 0 );
+  wait_parked++;
+  return 0;
+}
+
+/* int alloc_mem_notify( unsigned int amount, void (*fn)( void *ptr, void *arg ), void *arg )
+ *
+ * call fn with a block of "amount" bytes as soon as there is one;
+ * returns 0, or 1 if the request can never be met */
+
+int alloc_mem_notify( unsigned int amount, void (*fn)( void *ptr, void *arg ), void *arg ){
+  void *ptr;
+  int rc = 0;
+
+  if( amount == 0 || amount > wait_capacity() ) return 1;
+  pthread_mutex_lock( &heap_lock );
+  ptr = alloc_mem( amount );
+  if( ptr != NULL ) fn( ptr, arg );
+  else rc = wait_park( WAIT_CALLBACK, amount, -1, fn, arg );
+  pthread_mutex_unlock( &heap_lock );
+  return rc;
+}
+
+/* int alloc_mem_eventfd( unsigned int amount, int fd )
+ *
+ * signal the eventfd once a block of "amount" bytes is free (at once if
+ * there is one now); returns 0, or 1 if the request can never be met */
+
+int alloc_mem_eventfd( unsigned int amount, int fd ){
+  int rc = 0;
+
+  if( amount == 0 || amount > wait_capacity() ) return 1;
+  pthread_mutex_lock( &heap_lock );
+  if( fi_search( ( amount + 15 ) & ~15U ) >= 0 ) eventfd_write( fd, 1 );
+  else rc = wait_park( WAIT_EVENTFD, amount, fd, NULL, NULL );
+  pthread_mutex_unlock( &heap_lock );
+  return rc;
+}
+
+void alloc_mem_cancel_eventfd( int fd ){
+  struct waiter *w, *next;
+
+  pthread_mutex_lock( &heap_lock );
+  for( w = wait_head; w != NULL; w = next ){
+    next = w->next;
+    if( w->kind == WAIT_EVENTFD && w->fd == fd ){
+      wait_unlink( w );
+      free( w );
+    }
+  }
+  wait_update_min();
+  pthread_mutex_unlock( &heap_lock );
+}
+
+/* asynchronous release
+ *
+ * release_mem_async( ptr ) hands a block to a background reclaimer
+ * instead of releasing it in the caller, so that the neighbour tests,
+ * coalescing and list relinking of release_mem() are off the caller's
+ * path. The caller only checks the top tag, renames its signature to
+ * "top_pendng" (so that a second release of the block fails) and
+ * pushes the block on a queue of its own thread. The queue is a stack
+ * linked through the first word of each payload; the caller pushes with
+ * a compare-and-swap and the reclaimer takes the whole stack with one
+ * exchange, so neither side waits for the other. Only a push onto an
+ * empty stack reads the clock, and keeps the time in the second word of
+ * the payload: that block is the oldest of the batch the reclaimer will
+ * take, and its age is the reclaim lag of the batch.
+ *
+ * async_start( interval_us ) starts the reclaimer, which wakes every
+ * interval_us microseconds, or when a thread has pushed ASYNC_KICK more
+ * blocks, and drains all queues: it sorts the blocks by address and
+ * releases them in that order under heap_lock, so that neighbouring
+ * blocks coalesce as they go back. async_stop() stops it after a last
+ * drain. async_reclaim() drains in the calling thread.
+ *
+ * Under pressure release_mem_async() drains synchronously itself: when
+ * a caller is parked in alloc_mem_wait() or its other forms, or when
+ * async_sync_depth is nonzero and the caller's own queue has reached
+ * that many blocks. get_async_stats() reports
+ *
+ *   depth                blocks queued and not yet released
+ *   released, invalid    blocks drained, and those of them that
+ *                        release_mem() rejected
+ *   drains, sync_drains  drains that found blocks, and those of them
+ *                        done under pressure by release_mem_async()
+ *   batches              nonempty queues taken by the drains
+ *   lag_max_ns           the longest and the mean time that the oldest
+ *   lag_avg_ns           block of a batch waited to be taken
+ *
+ * A thread's queue stays registered after the thread exits. Callers of
+ * release_mem_async() and async_reclaim() must not hold heap_lock.
+ */
+
+#define ASYNC_KICK 256
+
+struct async_queue {
+  struct async_queue *next;
+  void *head;
+  unsigned long pushed, drained;
+};
+
+struct async_stats {
+  unsigned long depth;
+  unsigned long released, invalid;
+  unsigned long drains, sync_drains, batches;
+  unsigned long lag_max_ns, lag_avg_ns;
+};
+
+struct async_queue *async_queues = NULL;
+__thread struct async_queue *async_self;
+pthread_mutex_t async_lock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t async_cond = PTHREAD_COND_INITIALIZER;
+pthread_mutex_t async_drain_lock = PTHREAD_MUTEX_INITIALIZER;
+pthread_t async_thread;
+int async_running = 0;
+unsigned int async_interval_us = 1000;
+unsigned long async_sync_depth = 0;
+struct async_stats async_stats;
+uint64_t async_lag_sum;
+void **async_buf;
+size_t async_buf_len;
+
+uint64_t async_now(){
+  struct timespec ts;
+
+  clock_gettime( CLOCK_MONOTONIC, &ts );
+  return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+struct async_queue *async_register(){
+  struct async_queue *q = (struct async_queue *) calloc( 1, sizeof( struct async_queue ) );
+
+  if( q == NULL ){ printf( "no memory!\n" ); exit(0); }
+  pthread_mutex_lock( &async_lock );
+  q->next = async_queues;
+  async_queues = q;
+  pthread_mutex_unlock( &async_lock );
+  async_self = q;
+  return q;
+}
+
+int async_cmp( const void *a, const void *b ){
+  char *x = *(char * const *) a, *y = *(char * const *) b;
+  return ( x > y ) - ( x < y );
+}
+
+/* take every queued block, and release them in address order; returns
+ * the number of blocks */
+
+unsigned long async_drain( int sync ){
+  struct async_queue *q;
+  void **link, **grown;
+  size_t n = 0;
+  uint64_t now, lag;
+  unsigned long k;
+  size_t i;
+
+  pthread_mutex_lock( &async_drain_lock );
+  pthread_mutex_lock( &async_lock );
+  q = async_queues;
+  pthread_mutex_unlock( &async_lock );
+  // queues are only added at the head, so the rest of the list is stable
+  for( ; q != NULL; q = q->next ){
+    link = (void **) __atomic_exchange_n( &q->head, NULL, __ATOMIC_ACQUIRE );
+    if( link == NULL ) continue;
+    now = async_now();
+    for( k = 0; link != NULL; k++, link = (void **) link[0] ){
+      if( n == async_buf_len ){
+        grown = (void **) realloc( async_buf, ( n ? 2 * n : 1024 ) * sizeof( void * ) );
+        if( grown == NULL ){ printf( "no memory!\n" ); exit(0); }
+        async_buf = grown;
+        async_buf_len = n ? 2 * n : 1024;
+      }
+      async_buf[n++] = link;
+    }
+    __atomic_store_n( &q->drained, q->drained + k, __ATOMIC_RELAXED );
+    lag = now - (uint64_t) (uintptr_t) ( (void **) async_buf[n - 1] )[1];
+    if( lag > async_stats.lag_max_ns ) async_stats.lag_max_ns = lag;
+    async_lag_sum += lag;
+    async_stats.batches++;
+  }
+
+  if( n > 0 ){
+    qsort( async_buf, n, sizeof( void * ), async_cmp );
+    pthread_mutex_lock( &heap_lock );
+    for( i = 0; i < n; i++ ){
+      link = (void **) async_buf[i];
+      strcpy( ( (struct tag_block *) link - 1 )->sig, "top_alcblk" );
+      if( release_mem( link ) ) async_stats.invalid++;
+    }
+    pthread_mutex_unlock( &heap_lock );
+    async_stats.released += n;
+    async_stats.drains++;
+    if( sync ) async_stats.sync_drains++;
+  }
+  pthread_mutex_unlock( &async_drain_lock );
+  return n;
+}
+
+unsigned long async_reclaim(){
+  return async_drain( 1 );
+}
+
+void *async_reclaimer( void *arg ){
+  struct timespec deadline;
+
+  pthread_mutex_lock( &async_lock );
+  while( async_running ){
+    clock_gettime( CLOCK_REALTIME, &deadline );
+    deadline.tv_nsec += async_interval_us * 1000L;
+    deadline.tv_sec += deadline.tv_nsec / 1000000000L;
+    deadline.tv_nsec %= 1000000000L;
+    pthread_cond_timedwait( &async_cond, &async_lock, &deadline );
+    pthread_mutex_unlock( &async_lock );
+    async_drain( 0 );
+    pthread_mutex_lock( &async_lock );
+  }
+  pthread_mutex_unlock( &async_lock );
+  async_drain( 0 );
+  return arg;
+}
+
+void async_start( unsigned int interval_us ){
+  if( async_running ) return;
+  async_interval_us = interval_us ? interval_us : 1;
+  async_running = 1;
+  if( pthread_create( &async_thread, NULL, async_reclaimer, NULL ) != 0 ) async_running = 0;
+}
+
+void async_stop(){
+  if( !async_running ) return;
+  pthread_mutex_lock( &async_lock );
+  async_running = 0;
+  pthread_cond_signal( &async_cond );
+  pthread_mutex_unlock( &async_lock );
+  pthread_join( async_thread, NULL );
+}
+
+/* unsigned int release_mem_async( void *ptr )
+ *
+ * queue an allocated block for the reclaimer; returns 0, or 1 if ptr
+ * is not an allocated block (or is already queued) */
+
+unsigned int release_mem_async( void *ptr ){
+  struct async_queue *q = async_self;
+  struct tag_block *tb = (struct tag_block *) ptr - 1;
+  void **link = (void **) ptr, *old;
+  unsigned long depth;
+
+  if( ptr == NULL ) return 1;
+  if( strncmp( tb->sig, "top_alcblk", 10 ) != 0 || tb->tag != 1 ) return 1;
+  strcpy( tb->sig, "top_pendng" );
+  if( q == NULL ) q = async_register();
+
+  old = __atomic_load_n( &q->head, __ATOMIC_RELAXED );
+  do{
+    link[0] = old;
+    if( old == NULL ) link[1] = (void *) (uintptr_t) async_now();
+  }while( !__atomic_compare_exchange_n( &q->head, &old, ptr, 1, __ATOMIC_RELEASE, __ATOMIC_RELAXED ) );
+  __atomic_store_n( &q->pushed, q->pushed + 1, __ATOMIC_RELAXED );
+
+  depth = q->pushed - __atomic_load_n( &q->drained, __ATOMIC_RELAXED );
+  if( __atomic_load_n( &wait_min, __ATOMIC_RELAXED ) != 0xffffffff
+      || ( async_sync_depth != 0 && depth >= async_sync_depth ) )
+    async_drain( 1 );
+  else if( async_running && q->pushed % ASYNC_KICK == 0 )
+    pthread_cond_signal( &async_cond );
+  return 0;
+}
+
+void get_async_stats( struct async_stats *out ){
+  struct async_queue *q;
+
+  pthread_mutex_lock( &async_drain_lock );
+  *out = async_stats;
+  out->depth = 0;
+  pthread_mutex_lock( &async_lock );
+  for( q = async_queues; q != NULL; q = q->next )
+    out->depth += __atomic_load_n( &q->pushed, __ATOMIC_RELAXED ) - q->drained;
+  pthread_mutex_unlock( &async_lock );
+  out->lag_avg_ns = out->batches ? async_lag_sum / out->batches : 0;
+  pthread_mutex_unlock( &async_drain_lock );
+}
+
+/* epoch-based reclamation
+ *
+ * Lock-free structures whose nodes come from this heap cannot release
+ * an unlinked node while a reader may still be looking at it. Readers
+ * bracket each traversal with epoch_enter() and epoch_exit(), which may
+ * nest, and writers hand unlinked nodes to retire_mem( ptr ) instead of
+ * release_mem().
+ *
+ * epoch_global counts up from 1. epoch_enter() records the global
+ * epoch in the thread's record (0 means outside), and the epoch can
+ * only advance from e to e + 1 while every thread inside has recorded
+ * e. A node retired during epoch e is therefore unreachable to every
+ * reader once the global epoch is e + 2. retire_mem() puts nodes in one
+ * of three bags of the calling thread, one per epoch modulo 3, and
+ * every EPOCH_BATCH nodes it tries to advance the epoch and releases
+ * the bags that have become safe, sorted by address and under
+ * heap_lock.
+ *
+ * A bag holds at most EPOCH_BAG nodes, so retired memory is bounded
+ * per thread. A writer that finds its bag full waits for the readers
+ * to move on. If the writer is itself inside a section that holds the
+ * epoch back, waiting could never end, so retire_mem() returns 1
+ * instead and the node stays with the caller. epoch_flush(), called
+ * outside any section, waits until all nodes the thread has retired are
+ * released, for use before the thread exits. Callers must not hold
+ * heap_lock.
+ */
+
+#include <sched.h>
+
+#define EPOCH_BAG 1024
+#define EPOCH_BATCH 64
+
+struct epoch_thread {
+  struct epoch_thread *next;
+  unsigned long local;
+  int depth;
+  unsigned long bag_epoch[3];
+  unsigned int count[3];
+  void *bag[3][EPOCH_BAG];
+};
+
+unsigned long epoch_global = 1;
+struct epoch_thread *epoch_threads = NULL;
+__thread struct epoch_thread *epoch_self;
+pthread_mutex_t epoch_lock = PTHREAD_MUTEX_INITIALIZER;
+unsigned long epoch_advances, epoch_retired, epoch_released;
+
+struct epoch_thread *epoch_register(){
+  struct epoch_thread *t = (struct epoch_thread *) calloc( 1, sizeof( struct epoch_thread ) );
+
+  if( t == NULL ){ printf( "no memory!\n" ); exit(0); }
+  pthread_mutex_lock( &epoch_lock );
+  t->next = epoch_threads;
+  __atomic_store_n( &epoch_threads, t, __ATOMIC_RELEASE );
+  pthread_mutex_unlock( &epoch_lock );
+  epoch_self = t;
+  return t;
+}
+
+void epoch_enter(){
+  struct epoch_thread *t = epoch_self;
+
+  if( t == NULL ) t = epoch_register();
+  if( t->depth++ == 0 )
+    __atomic_store_n( &t->local, __atomic_load_n( &epoch_global, __ATOMIC_SEQ_CST ), __ATOMIC_SEQ_CST );
+}
+
+void epoch_exit(){
+  struct epoch_thread *t = epoch_self;
+
+  if( t != NULL && t->depth > 0 && --t->depth == 0 )
+    __atomic_store_n( &t->local, 0, __ATOMIC_RELEASE );
+}
+
+/* advance the global epoch if every thread inside has seen it */
+
+void epoch_try_advance(){
+  unsigned long g = __atomic_load_n( &epoch_global, __ATOMIC_SEQ_CST ), l;
+  struct epoch_thread *t;
+
+  for( t = __atomic_load_n( &epoch_threads, __ATOMIC_ACQUIRE ); t != NULL; t = t->next ){
+    l = __atomic_load_n( &t->local, __ATOMIC_SEQ_CST );
+    if( l != 0 && l != g ) return;
+  }
+  if( __atomic_compare_exchange_n( &epoch_global, &g, g + 1, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST ) )
+    __atomic_fetch_add( &epoch_advances, 1, __ATOMIC_RELAXED );
+}
+
+/* release the bags of the thread that no reader can still reach */
+
+void epoch_reclaim( struct epoch_thread *t ){
+  unsigned long g = __atomic_load_n( &epoch_global, __ATOMIC_SEQ_CST );
+  unsigned int i, k;
+
+  for( i = 0; i < 3; i++ ){
+    if( t->count[i] == 0 || t->bag_epoch[i] + 2 > g ) continue;
+    qsort( t->bag[i], t->count[i], sizeof( void * ), async_cmp );
+    pthread_mutex_lock( &heap_lock );
+    for( k = 0; k < t->count[i]; k++ ) release_mem( t->bag[i][k] );
+    pthread_mutex_unlock( &heap_lock );
+    __atomic_fetch_add( &epoch_released, t->count[i], __ATOMIC_RELAXED );
+    t->count[i] = 0;
+  }
+}
+
+/* unsigned int retire_mem( void *ptr )
+ *
+ * release ptr once no reader can reach it; returns 0, or 1 if ptr is
+ * NULL or the bag is full and the caller's own section holds it back */
+
+unsigned int retire_mem( void *ptr ){
+  struct epoch_thread *t = epoch_self;
+  unsigned long g;
+  unsigned int i;
+
+  if( ptr == NULL ) return 1;
+  if( t == NULL ) t = epoch_register();
+  for( ;; ){
+    g = __atomic_load_n( &epoch_global, __ATOMIC_SEQ_CST );
+    i = g % 3;
+    // a bag of an older epoch in this slot is at least 3 epochs old
+    if( t->count[i] != 0 && t->bag_epoch[i] != g ) epoch_reclaim( t );
+    if( t->count[i] < EPOCH_BAG ) break;
+    epoch_try_advance();
+    epoch_reclaim( t );
+    if( t->depth > 0 && t->local != __atomic_load_n( &epoch_global, __ATOMIC_SEQ_CST ) ) return 1;
+    sched_yield();
+  }
+  t->bag_epoch[i] = g;
+  t->bag[i][t->count[i]++] = ptr;
+  __atomic_fetch_add( &epoch_retired, 1, __ATOMIC_RELAXED );
+  if( t->count[i] % EPOCH_BATCH == 0 ){
+    epoch_try_advance();
+    epoch_reclaim( t );
+  }
+  return 0;
+}
+
+void epoch_flush(){
+  struct epoch_thread *t = epoch_self;
+
+  if( t == NULL || t->depth > 0 ) return;
+  while( t->count[0] + t->count[1] + t->count[2] != 0 ){
+    epoch_try_advance();
+    epoch_reclaim( t );
+    if( t->count[0] + t->count[1] + t->count[2] != 0 ) sched_yield();
+  }
+}
+
+/* reference-counted buffers
+ *
+ * buf_alloc( length ) allocates a block whose first 16 bytes, just
+ * below the top tag block, are a buffer header with an atomic count of
+ * references and the length of the payload that follows. (The tag
+ * block itself has no room to spare: its bytes are the tag, the
+ * signature that release_mem() checks, and the size.) It returns a
+ * slice, a value of a buffer and an offset and length in its payload,
+ * that holds one reference:
+ *
+ *   struct buf_slice pkt = buf_alloc( 1500 );
+ *   struct buf_slice hdr = buf_slice( pkt, 0, 20 );     // refs 2
+ *   struct buf_slice body = buf_slice( pkt, 20, 1480 ); // refs 3
+ *   buf_drop( &pkt );                                   // refs 2
+ *
+ * buf_slice() and buf_ref() take another reference without copying,
+ * and a slice is clamped to the slice it is cut from. buf_drop() gives
+ * one back, and the last one releases the block. buf_data() points at
+ * the first byte of a slice, and buf_iovec() fills an iovec array so
+ * that slices can go to writev() or sendmsg() as they are. The count is
+ * atomic, so slices can be handed between threads; the block is
+ * allocated and released with the _locked calls.
+ */
+
+#include <sys/uio.h>
+
+struct buf_header { unsigned int refs, length; uint64_t reserved; };
+struct buf_slice { struct buf_header *buf; unsigned int offset, length; };
+
+struct buf_slice buf_alloc( unsigned int length ){
+  struct buf_slice s = { NULL, 0, 0 };
+  struct buf_header *b;
+
+  if( length == 0 || length > 0xffffffff - sizeof( struct buf_header ) ) return s;
+  b = (struct buf_header *) alloc_mem_locked( sizeof( struct buf_header ) + length );
+  if( b == NULL ) return s;
+  b->refs = 1;
+  b->length = length;
+  s.buf = b;
+  s.length = length;
+  return s;
+}
+
+char *buf_data( struct buf_slice s ){
+  return (char *) ( s.buf + 1 ) + s.offset;
+}
+
+struct buf_slice buf_ref( struct buf_slice s ){
+  if( s.buf != NULL ) __atomic_fetch_add( &s.buf->refs, 1, __ATOMIC_RELAXED );
+  return s;
+}
+
+struct buf_slice buf_slice( struct buf_slice s, unsigned int offset, unsigned int length ){
+  if( offset > s.length ) offset = s.length;
+  if( length > s.length - offset ) length = s.length - offset;
+  s.offset += offset;
+  s.length = length;
+  return buf_ref( s );
+}
+
+void buf_drop( struct buf_slice *s ){
+  if( s->buf != NULL && __atomic_sub_fetch( &s->buf->refs, 1, __ATOMIC_ACQ_REL ) == 0 )
+    release_mem_locked( s->buf );
+  s->buf = NULL;
+  s->offset = s->length = 0;
+}
+
+/* fill iov with up to n slices; returns the number filled */
+
+int buf_iovec( struct buf_slice *s, int n, struct iovec *iov ){
+  int i, k = 0;
+
+  for( i = 0; i < n; i++ ){
+    if( s[i].buf == NULL || s[i].length == 0 ) continue;
+    iov[k].iov_base = buf_data( s[i] );
+    iov[k].iov_len = s[i].length;
+    k++;
+  }
+  return k;
+}
+
+/* compressed handles
+ *
+ * Every block's payload starts on a 16-byte boundary of the region, so
+ * a block can also be named by its offset from region_base divided by
+ * 16. That fits in 32 bits for regions of up to 64 GiB, which covers
+ * every region here because its size is an unsigned int. Offset 0 is
+ * the "end_region" tag block, never a payload, so handle 0 stands for
+ * NULL. Decoding is region_base + ( h << 4 ); heap_handle.hpp does it
+ * inline and adds C++ smart-handle wrappers.
+ */
+
+unsigned int ptr_to_handle( void *ptr ){
+  size_t off = (char *) ptr - region_base;
+
+  if( ptr == NULL || (char *) ptr < region_base || off >= region_length || off % 16 != 0 ) return 0;
+  return (unsigned int) ( off >> 4 );
+}
+
+void *handle_to_ptr( unsigned int h ){
+  return h ? region_base + ( (size_t) h << 4 ) : NULL;
+}
+
+unsigned int alloc_handle( unsigned int amount ){
+  return ptr_to_handle( alloc_mem( amount ) );
+}
+
+unsigned int release_handle( unsigned int h ){
+  return h ? release_mem( handle_to_ptr( h ) ) : 1;
+}
+
+/* lifetime classes
+ *
+ * When short-lived and long-lived blocks share a region, a few
+ * long-lived survivors end up between the holes of short-lived ones,
+ * and those holes can never coalesce. alloc_mem_life( amount, life )
+ * keeps the two kinds apart inside the one region. LIFE_SHORT blocks
+ * are placed by alloc_mem(), which takes the bottom of the first
+ * fitting free block. LIFE_LONG blocks take the top of the fitting free
+ * block at the lowest address, so long-lived blocks pack toward the
+ * start of the region and the holes of short-lived ones stay next to
+ * each other.
+ *
+ * LIFE_AUTO uses a class learned per block size from release timing
+ * once life_learn( 1 ) is on; until then it means LIFE_SHORT. While
+ * learning, alloc_mem(), carve_block() (under alloc_mem_aligned(),
+ * alloc_mem_near(), alloc_mem_isolated() and alloc_mem_life()) and
+ * release_mem() count the blocks of each size class (16 << k bytes, as
+ * in alloc_stats) as they are allocated and released, so every path
+ * that hands out a block is matched by its release. Blocks allocated
+ * before learning started are counted only when released, which biases
+ * their classes toward short until they are gone. Every LIFE_WINDOW
+ * allocations the mean lifetime of each class, in allocations, is
+ * estimated by Little's law as its live blocks over the rate at which
+ * it released blocks in the window. A class with live blocks and a
+ * mean lifetime of at least life_threshold allocations is long-lived.
+ *
+ * A REGION_RESERVE region commits pages from its end down, so LIFE_LONG
+ * placement would commit all of it; there every class goes to
+ * alloc_mem(). largest_free() returns the size of the largest free
+ * block, the largest request the heap can meet.
+ *
+ * Finding the lowest fitting block scans every entry of the free block
+ * index, dead entries included (at most as many as the live ones), so
+ * a LIFE_LONG allocation costs O(fi_count) where alloc_mem() usually
+ * stops at the first fit. That suits blocks that are long-lived and so
+ * allocated rarely; a class allocated often should not be LIFE_LONG.
+ */
+
+#define LIFE_AUTO 0
+#define LIFE_SHORT 1
+#define LIFE_LONG 2
+#define LIFE_CLASSES 20
+#define LIFE_WINDOW 4096
+
+int life_learning = 0;
+unsigned long life_threshold = 65536;
+unsigned long life_clock;
+unsigned long life_allocs[LIFE_CLASSES], life_releases[LIFE_CLASSES], life_recent[LIFE_CLASSES];
+unsigned long life_lifetime[LIFE_CLASSES];
+unsigned char life_long[LIFE_CLASSES];
+
+unsigned int life_class( unsigned int size ){
+  unsigned int k = ( size <= 16 ) ? 0 : 64 - __builtin_clzll( ( size - 1 ) / 16 );
+  return ( k < LIFE_CLASSES ) ? k : LIFE_CLASSES - 1;
+}
+
+void life_update(){
+  unsigned long live;
+  unsigned int k;
+
+  for( k = 0; k < LIFE_CLASSES; k++ ){
+    live = ( life_allocs[k] > life_releases[k] ) ? life_allocs[k] - life_releases[k] : 0;
+    if( life_recent[k] != 0 ) life_lifetime[k] = live * LIFE_WINDOW / life_recent[k];
+    else life_lifetime[k] = live ? (unsigned long) -1 : 0;
+    life_long[k] = ( live != 0 && life_lifetime[k] >= life_threshold );
+    life_recent[k] = 0;
+  }
+}
+
+void life_note_alloc( unsigned int size ){
+  life_allocs[life_class( size )]++;
+  if( ++life_clock % LIFE_WINDOW == 0 ) life_update();
+}
+
+void life_note_release( unsigned int size ){
+  unsigned int k = life_class( size );
+
+  life_releases[k]++;
+  life_recent[k]++;
+}
+
+/* turn learning on (starting from nothing) or off; what was learned
+ * stays in life_long while learning is off, but LIFE_AUTO ignores it */
+
+void life_learn( int on ){
+  if( on && !life_learning ){
+    memset( life_allocs, 0, sizeof( life_allocs ) );
+    memset( life_releases, 0, sizeof( life_releases ) );
+    memset( life_recent, 0, sizeof( life_recent ) );
+    memset( life_long, 0, sizeof( life_long ) );
+    life_clock = 0;
+  }
+  life_learning = on;
+}
+
+/* the entry of the free block at the lowest address that holds "size"
+ * bytes, or -1; reads all fi_count entries */
+
+int life_search_low( unsigned int size ){
+  unsigned int i, low = 0xffffffff;
+  int entry = -1;
+
+  for( i = 0; i < fi_count; i++ )
+    if( fi_size[i] >= size && fi_offset[i] < low ){
+      low = fi_offset[i];
+      entry = i;
+    }
+  return entry;
+}
+
+unsigned int largest_free(){
+  unsigned int i, size = 0;
+
+  for( i = 0; i < fi_count; i++ ) if( fi_size[i] > size ) size = fi_size[i];
+  return size;
+}
+
+/* ring allocation
+ *
+ * Messages that are allocated in arrival order and released in about
+ * the same order make alloc_mem() split and coalesce blocks for each
+ * one. A ring takes one block from the heap and serves variable-size
+ * records from it in order:
+ *
+ *   struct ring *r = ring_create( 1 << 20, RING_SPSC );
+ *   char *msg = ring_alloc( r, 300 );   // NULL while the ring is full
+ *   ...                                 // fill in the message
+ *   ring_commit( r, msg );              // only needed for ring_next()
+ *   ...
+ *   ring_free( r, msg );
+ *   ring_destroy( r );
+ *
+ * Each record is a 16-byte header (the record size and a state) and a
+ * payload rounded up to 16 bytes. head and tail are byte counts that
+ * only grow: ring_alloc() places a record at head and advances it, and
+ * wraps to the start of the data by writing a pad record over the rest
+ * when a record would not fit before the end. ring_free() marks a
+ * record done and then moves tail over every done or pad record at the
+ * tail, so records released out of order are reclaimed once the older
+ * ones are released too. ring_next( r, prev ) returns the committed
+ * record after prev, or the oldest one when prev is NULL, so that a
+ * consumer can read records in the order they were allocated; it stops
+ * at a record that is allocated but not yet committed. ring_used() is
+ * the number of bytes between tail and head.
+ *
+ * By default every call takes the ring's mutex, so any threads may use
+ * it. With RING_SPSC no lock is taken: one thread (the producer) may
+ * call ring_alloc() and another (the consumer) ring_next() and
+ * ring_free(). Only the producer writes head and only the consumer
+ * writes tail; head is published with release order after the record
+ * header is written, a record's state with release order when it is
+ * committed, and tail after the records it passes are done.
+ * The ring header is aligned to a cache line and laid out so that head
+ * and the counters only the producer writes fill one line, tail fills
+ * the next, and the fields both sides only read (data, size and
+ * flags) come after them, sharing a line only with the mutex, which a
+ * RING_SPSC ring never takes.
+ */
+
+#define CACHE_LINE 64
+#define RING_SPSC 1
+#define RING_BUSY 1
+#define RING_READY 2
+#define RING_DONE 3
+#define RING_PAD 4
+
+struct ring_record { unsigned int size, state; uint64_t reserved; };
+
+struct ring {
+  unsigned long head, records, wraps;
+  char head_line[CACHE_LINE - 3 * sizeof( unsigned long )];
+  unsigned long tail;
+  char tail_line[CACHE_LINE - sizeof( unsigned long )];
+  char *data;
+  unsigned int size, flags;
+  pthread_mutex_t lock;
+};
+
+_Static_assert( offsetof( struct ring, tail ) == CACHE_LINE && offsetof( struct ring, data ) == 2 * CACHE_LINE,
+  "ring head, tail and read-only fields must start cache lines" );
+
+struct ring *ring_create( unsigned int bytes, unsigned int flags ){
+  struct ring *r;
+
+  bytes = ( bytes + 15 ) & ~15U;
+  if( bytes == 0 || bytes > 0xffffffff - sizeof( struct ring ) - 16 ) return NULL;
+  pthread_mutex_lock( &heap_lock );
+  r = (struct ring *) alloc_mem_aligned( sizeof( struct ring ) + bytes, CACHE_LINE );
+  pthread_mutex_unlock( &heap_lock );
+  if( r == NULL ) return NULL;
+  memset( r, 0, sizeof( struct ring ) );
+  r->data = (char *) r + ( ( sizeof( struct ring ) + 15 ) & ~15UL );
+  r->size = bytes;
+  r->flags = flags;
+  pthread_mutex_init( &r->lock, NULL );
+  return r;
+}
+
+void ring_destroy( struct ring *r ){
+  if( r == NULL ) return;
+  pthread_mutex_destroy( &r->lock );
+  release_mem_locked( r );
+}
+
+void *ring_alloc( struct ring *r, unsigned int amount ){
+  struct ring_record *rec;
+  unsigned long head, tail;
+  unsigned int need, pos, pad;
+
+  if( amount == 0 || amount > r->size ) return NULL;
+  need = sizeof( struct ring_record ) + ( ( amount + 15 ) & ~15U );
+  if( need > r->size ) return NULL;
+  if( !( r->flags & RING_SPSC ) ) pthread_mutex_lock( &r->lock );
+  head = r->head;
+  tail = __atomic_load_n( &r->tail, __ATOMIC_ACQUIRE );
+  pos = head % r->size;
+  pad = ( pos + need > r->size ) ? r->size - pos : 0;
+  if( head + pad + need - tail > r->size ){
+    rec = NULL;
+  }else{
+    if( pad ){
+      rec = (struct ring_record *) ( r->data + pos );
+      rec->size = pad;
+      rec->state = RING_PAD;
+      head += pad;
+      r->wraps++;
+    }
+    rec = (struct ring_record *) ( r->data + head % r->size );
+    rec->size = need;
+    rec->state = RING_BUSY;
+    r->records++;
+    __atomic_store_n( &r->head, head + need, __ATOMIC_RELEASE );
+    rec++;
+  }
+  if( !( r->flags & RING_SPSC ) ) pthread_mutex_unlock( &r->lock );
+  return rec;
+}
+
+/* make a record visible to ring_next() */
+
+void ring_commit( struct ring *r, void *ptr ){
+  __atomic_store_n( &( (struct ring_record *) ptr - 1 )->state, RING_READY, __ATOMIC_RELEASE );
+}
+
+/* returns 0 on success, 1 if ptr is not a live record of the ring */
+
+unsigned int ring_free( struct ring *r, void *ptr ){
+  struct ring_record *rec = (struct ring_record *) ptr - 1;
+  unsigned long head, tail;
+  unsigned int state;
+  size_t off = (char *) rec - r->data;
 
-  printf( "data structure starts at %p\n", region_base );
-  printf( "free_list is located at %p\n", free_list);
+  if( ptr == NULL || (char *) rec < r->data || off >= r->size || off % 16 != 0 ) return 1;
+  if( !( r->flags & RING_SPSC ) ) pthread_mutex_lock( &r->lock );
+  if( rec->state != RING_BUSY && rec->state != RING_READY ){
+    if( !( r->flags & RING_SPSC ) ) pthread_mutex_unlock( &r->lock );
+    return 1;
+  }
+  rec->state = RING_DONE;
+  tail = r->tail;
+  head = __atomic_load_n( &r->head, __ATOMIC_ACQUIRE );
+  while( tail != head ){
+    rec = (struct ring_record *) ( r->data + tail % r->size );
+    state = __atomic_load_n( &rec->state, __ATOMIC_RELAXED );
+    if( state == RING_BUSY || state == RING_READY ) break;
+    tail += rec->size;
+  }
+  __atomic_store_n( &r->tail, tail, __ATOMIC_RELEASE );
+  if( !( r->flags & RING_SPSC ) ) pthread_mutex_unlock( &r->lock );
+  return 0;
 }
 
-void prt_free_block( struct free_block *fb ){
-  struct tag_block *tb = (struct tag_block *)((char *)(fb) - 16);
-  printf( "   free block at %p of size 0x%x\n", (char *)fb, tb->size );
-  TOPSIGCHK(tb,"prt_free_block")
-  ENDSIGCHK((char *)(tb)+(tb->size)+16,"prt_free_block")
-}
+/* the committed record after prev, which must still be live, or the
+ * oldest one if prev is NULL; NULL when there is none yet */
 
-void prt_free_list(){
-  struct free_block *ptr;
-  if( free_list->fwd_link == free_list ){
-    printf( "   ----------free list is empty-----------\n" );
-    return;
+void *ring_next( struct ring *r, void *prev ){
+  struct ring_record *rec;
+  unsigned long head, tail, pos;
+  unsigned int state;
+  void *next = NULL;
+
+  if( !( r->flags & RING_SPSC ) ) pthread_mutex_lock( &r->lock );
+  head = __atomic_load_n( &r->head, __ATOMIC_ACQUIRE );
+  tail = __atomic_load_n( &r->tail, __ATOMIC_ACQUIRE );
+  pos = tail;
+  if( prev != NULL ){
+    // prev lies between tail and head, so its end is at most one lap past tail
+    rec = (struct ring_record *) prev - 1;
+    pos = ( (char *) rec - r->data + rec->size + r->size - tail % r->size ) % r->size;
+    pos = pos ? tail + pos : head;
   }
-  printf( "   ---------------free list---------------\n" );
-  ptr = free_list->fwd_link;
-  prt_free_block( ptr );
-  ptr = ptr->fwd_link;
-  while( ptr != free_list ){
-    prt_free_block( ptr );
-    ptr = ptr->fwd_link;
+  for( ; pos < head; pos += rec->size ){
+    rec = (struct ring_record *) ( r->data + pos % r->size );
+    state = __atomic_load_n( &rec->state, __ATOMIC_ACQUIRE );
+    if( state == RING_BUSY ) break;
+    if( state == RING_READY ){
+      next = rec + 1;
+      break;
+    }
   }
-  printf( "   --------------end of list--------------\n" );
+  if( !( r->flags & RING_SPSC ) ) pthread_mutex_unlock( &r->lock );
+  return next;
+}
+
+unsigned int ring_used( struct ring *r ){
+  return __atomic_load_n( &r->head, __ATOMIC_ACQUIRE ) - __atomic_load_n( &r->tail, __ATOMIC_ACQUIRE );
 }
 
 
 
+
+
 /* void *alloc_mem( unsigned int amount )
  *
  * input parameter
@@ -267,32 +2734,42 @@ void prt_free_list(){
 void *alloc_mem( unsigned int amount ){
 
   /* your code here */
+	LAT_HOOK_ALLOC(amount)
+	if(__builtin_expect(engine_alloc != NULL, 0)) return engine_alloc(amount);
+	if(__builtin_expect(verify_budget != 0, 0)) verify_step(verify_budget);
 	if(amount == 0)	return NULL;
 
 	struct free_block *mem_ptr = NULL;
 	struct free_block *ptr;
 	struct tag_block *tag_ptr, *tag_ptr_f, *tag_ptr_a, *end_ptr;
 	int req_amt = (amount % 16 == 0) ? amount : ((amount / 16) + 1) * 16;
+	int entry;
 
-	// Step through the free list
-	ptr = free_list -> fwd_link;
-	tag_ptr = ((struct tag_block *) (ptr)) - 1;
+	// Search the free block index in free list order
+	if(region_mode == REGION_HUGEPAGE) entry = fi_search_huge(req_amt);
+	else entry = fi_search(req_amt);
 
-	while(ptr != NULL && ptr != free_list && mem_ptr == NULL) {
-		// Select first available node
-		if(tag_ptr->size >= req_amt) {
-			mem_ptr = ptr;
-		} else {
-			ptr = ptr -> fwd_link;
-			tag_ptr = ((struct tag_block *) ptr) - 1;
-		}
-	}
+	stat_search(fi_scanned, req_amt);
 
 	// If no sufficient free block could be found, return NULL
-	if(ptr == NULL || ptr == free_list) return NULL;
+	if(entry < 0) {
+		alloc_stats.failed++;
+		return NULL;
+	}
+	alloc_stats.round_waste += req_amt - amount;
+
+	ptr = FI_BLOCK(fi_offset[entry]);
+	tag_ptr = ((struct tag_block *) (ptr)) - 1;
+	mem_ptr = ptr;
 
 	// If block is larger than the request, split it
 	if(tag_ptr->size >= req_amt + 48) {
+		alloc_stats.splits++;
+
+		// Commit a reserved region down to the new ending tag of the free block
+		if(region_mode == REGION_RESERVE)
+			commit_region((char *) ptr + tag_ptr->size - req_amt - 2 * sizeof(struct tag_block));
+
 		// Top tag block will be assigned to new, smaller mem block
 		tag_ptr->tag = 0;
 		// Bottom tag block will be assigned to allocated memblock
@@ -301,6 +2778,7 @@ void *alloc_mem( unsigned int amount ){
 		
 		// Add tag at bottom of free block
 		tag_ptr->size = tag_ptr->size - req_amt - 2 * sizeof(struct tag_block);
+		fi_resize(entry, tag_ptr->size);
 		tag_ptr_f = tag_ptr + (tag_ptr->size / 16) + 1;
 		tag_ptr_f->tag = 0;
 		strcpy(tag_ptr_f->sig, tag_ptr->sig);
@@ -327,6 +2805,10 @@ void *alloc_mem( unsigned int amount ){
 
 	// If block is approximately the same size as the request, allocate it
 	} else {
+		alloc_stats.whole++;
+		alloc_stats.whole_waste += tag_ptr->size - req_amt;
+
+		if(region_mode == REGION_RESERVE) commit_region((char *) tag_ptr);
 
 		tag_ptr->tag=1;
 		end_ptr = tag_ptr + (tag_ptr->size / 16) + 1;
@@ -336,18 +2818,302 @@ void *alloc_mem( unsigned int amount ){
 		struct free_block *prev = ptr->back_link;
 		prev->fwd_link = ptr->fwd_link;
 		ptr->fwd_link->back_link = prev;
+		fi_remove(entry);
 
 		strcpy(tag_ptr->sig, "top_alcblk");
 		strcpy(end_ptr->sig, "end_alcblk");
 	}
+
+	// Sample for the heap profiler once enough bytes have gone by
+	if(__builtin_expect((prof_countdown -= req_amt) < 0, 0)) prof_record(mem_ptr, amount);
+	if(__builtin_expect(life_learning, 0)) life_note_alloc(((struct tag_block *) mem_ptr - 1)->size);
  
 	return mem_ptr;
 }
 
 
+/* char *carve_block( int entry, char *user, unsigned int req_amt )
+ *
+ *   allocates req_amt bytes at "user" from the free block of index
+ *   entry i, splitting it in up to three as alloc_mem_aligned()
+ *   describes; the part above "user" must be empty or at least 48
+ *   bytes, and a part below of less than 48 bytes is absorbed
+ */
+
+char *carve_block( int entry, char *user, unsigned int req_amt ){
+	struct free_block *ptr, *new_ptr;
+	struct tag_block *tag_ptr, *tag_ptr_a, *end_ptr_a, *tag_ptr_b;
+	char *payload = region_base + fi_offset[entry];
+	char *limit = payload + fi_size[entry];
+	unsigned int above = user - payload, below;
+
+	ptr = (struct free_block *) payload;
+	tag_ptr = ((struct tag_block *) ptr) - 1;
+
+	// Absorb a remainder below the allocation that is too small to keep
+	below = limit - (user + req_amt);
+	if(below < 48) {
+		req_amt += below;
+		below = 0;
+	}
+
+	// Commit a reserved region down to the highest tag written below
+	if(region_mode == REGION_RESERVE)
+		commit_region(above == 0 ? (char *) tag_ptr : user - 2 * sizeof(struct tag_block));
+
+	if(above == 0) {
+		// Allocation takes over the top tag, so drop the free list node
+		tag_ptr_a = tag_ptr;
+		ptr->back_link->fwd_link = ptr->fwd_link;
+		ptr->fwd_link->back_link = ptr->back_link;
+		fi_remove(entry);
+	} else {
+		// Shrink the free block above and give it a new ending tag
+		tag_ptr->size = above - 2 * sizeof(struct tag_block);
+		fi_resize(entry, tag_ptr->size);
+		end_ptr_a = tag_ptr + (tag_ptr->size / 16) + 1;
+		end_ptr_a->tag = 0;
+		end_ptr_a->size = tag_ptr->size;
+		strcpy(end_ptr_a->sig, "end_memblk");
+		tag_ptr_a = ((struct tag_block *) user) - 1;
+	}
+
+	tag_ptr_a->tag = 1;
+	tag_ptr_a->size = req_amt;
+	strcpy(tag_ptr_a->sig, "top_alcblk");
+	end_ptr_a = tag_ptr_a + (req_amt / 16) + 1;
+	end_ptr_a->tag = 1;
+	end_ptr_a->size = req_amt;
+	strcpy(end_ptr_a->sig, "end_alcblk");
+
+	if(below != 0) {
+		// Remainder below becomes a new free block at the head of the list
+		tag_ptr_b = end_ptr_a + 1;
+		tag_ptr_b->tag = 0;
+		tag_ptr_b->size = below - 2 * sizeof(struct tag_block);
+		strcpy(tag_ptr_b->sig, "top_memblk");
+		end_ptr_a = tag_ptr_b + (tag_ptr_b->size / 16) + 1;
+		end_ptr_a->tag = 0;
+		end_ptr_a->size = tag_ptr_b->size;
+		strcpy(end_ptr_a->sig, "end_memblk");
+
+		new_ptr = (struct free_block *) (tag_ptr_b + 1);
+		new_ptr->back_link = free_list;
+		new_ptr->fwd_link = free_list->fwd_link;
+		free_list->fwd_link->back_link = new_ptr;
+		free_list->fwd_link = new_ptr;
+		fi_insert(new_ptr, tag_ptr_b->size);
+	}
+
+	if(__builtin_expect(life_learning, 0)) life_note_alloc(req_amt);
+	return user;
+}
+
+
+/* void *alloc_mem_aligned( unsigned int amount, unsigned int align )
+ *
+ * input parameters
+ *   amount is the number of bytes requested
+ *   align is the required alignment of the returned pointer; it must
+ *   be a power of two, and values below 16 are treated as 16
+ *
+ * return value
+ *   a pointer to the start of the allocated block that is a multiple
+ *   of "align", or NULL if no free block holds a suitably aligned
+ *   range (or for a zero-byte request or a bad alignment)
+ *
+ * description
+ *   alloc_mem_aligned() searches first fit like alloc_mem() and places
+ *   the allocation at the highest aligned address in the free block,
+ *   so the free block may be split in three. The part above the
+ *   allocation keeps the original free list node (only its size and
+ *   ending tag change) and the part below it becomes a new node at the
+ *   head of the free list. A part above must be empty or leave at
+ *   least 48 bytes (otherwise the next lower aligned address is
+ *   tried); a part below of less than 48 bytes is absorbed into the
+ *   allocated block, as alloc_mem() does for a small remainder.
+ */
+
+void *alloc_mem_aligned( unsigned int amount, unsigned int align ){
+	if(amount == 0) return NULL;
+	if(align < 16) align = 16;
+	if((align & (align - 1)) != 0) return NULL;
+	if(region_mode == REGION_BUDDY) return (align == 16) ? alloc_mem(amount) : NULL;
+
+	char *payload = NULL, *limit = NULL, *user = NULL;
+	unsigned int req_amt = ((amount + 15) / 16) * 16;
+	unsigned int above = 0;
+	int entry;
+
+	// Search the free block index in free list order for a block
+	// holding an aligned range; only the chosen block is read
+	for(entry = fi_count - 1; entry >= 0; entry--) {
+		if(fi_size[entry] < req_amt) continue;
+		payload = region_base + fi_offset[entry];
+		limit = payload + fi_size[entry];
+		user = (char *) ((uintptr_t) (limit - req_amt) & ~(uintptr_t) (align - 1));
+		while(user >= payload) {
+			above = user - payload;
+			if(above == 0 || above >= 48) break;
+			user -= align;
+		}
+		if(user >= payload) break;
+	}
+
+	// If no sufficient free block could be found, return NULL
+	if(entry < 0) return NULL;
+	return carve_block(entry, user, req_amt);
+}
+
+
+/* void *alloc_mem_isolated( unsigned int amount )
+ *
+ * input parameters
+ *   amount is the number of bytes requested
+ *
+ * return value
+ *   a pointer to a block that starts on a cache line and fills whole
+ *   cache lines, or NULL as for alloc_mem_aligned()
+ *
+ * description
+ *   alloc_mem_isolated() is for data that one thread writes often,
+ *   such as counters and per-thread state, which would otherwise share
+ *   a cache line with blocks written by other threads. The request is
+ *   rounded up to a multiple of CACHE_LINE bytes and placed by
+ *   alloc_mem_aligned() at a CACHE_LINE boundary, so the tags of the
+ *   block and of its neighbors lie in the lines before and after it
+ *   and no other block's payload shares its lines. The padding above
+ *   and below becomes free blocks when it is large enough, as in
+ *   alloc_mem_aligned(). The block is released with release_mem().
+ */
+
+void *alloc_mem_isolated( unsigned int amount ){
+	if(amount == 0 || amount > 0xffffffff - CACHE_LINE) return NULL;
+	return alloc_mem_aligned((amount + CACHE_LINE - 1) & ~(CACHE_LINE - 1), CACHE_LINE);
+}
+
+
+/* void *alloc_mem_near( void *hint, unsigned int amount )
+ *
+ * input parameters
+ *   hint is an allocated block that the new block will be used with
+ *   (the previous node of a list, the parent in a tree), or NULL
+ *   amount is the number of bytes requested
+ *
+ * return value
+ *   a pointer to the allocated block, or NULL as for alloc_mem()
+ *
+ * description
+ *   alloc_mem_near() prefers a free block in the same 4 KiB page as the
+ *   hint or in the page on either side of it. When fi_page shows that
+ *   no free block starts or ends in those three pages, none reaches
+ *   into them (one would have to cover all three, and the hint's block
+ *   is allocated), so it goes straight to alloc_mem(). Otherwise it walks the boundary tags from the hint's
+ *   block up and down to the edges of the three pages and takes the
+ *   nearer of the first free blocks that fit on each side: a block
+ *   above the hint gives its bottom and a block below gives its top,
+ *   so the new block lies as close to the hint as the free block
+ *   allows. If neither side has one, it falls back to alloc_mem().
+ *   near_hits and near_misses count the two outcomes.
+ */
+
+unsigned long near_hits, near_misses;
+
+void *alloc_mem_near( void *hint, unsigned int amount ){
+	struct tag_block *hint_tag, *hint_end, *tb, *up = NULL, *down = NULL;
+	char *lo, *hi, *payload, *user;
+	unsigned int req_amt, page;
+	int entry;
+
+	if(amount == 0) return NULL;
+	if(hint == NULL || region_mode == REGION_BUDDY
+	    || (char *) hint < region_base + 32 || (char *) hint >= (char *) region_top)
+		return alloc_mem(amount);
+	hint_tag = (struct tag_block *) hint - 1;
+	if(hint_tag->tag != 1 || strncmp(hint_tag->sig, "top_", 4) != 0) return alloc_mem(amount);
+	hint_end = hint_tag + (hint_tag->size / 16) + 1;
+	req_amt = ((amount + 15) / 16) * 16;
+
+	// Skip the walk when no free block starts or ends in the three pages
+	page = FI_PAGE((char *) hint - region_base);
+	if(fi_page[page] + fi_page[page + 1] + (page > 0 ? fi_page[page - 1] : 0) == 0) {
+		near_misses++;
+		return alloc_mem(amount);
+	}
+	lo = region_base + ((size_t) (page > 0 ? page - 1 : 0) << FI_PAGE_SHIFT);
+	hi = region_base + ((size_t) (page + 2) << FI_PAGE_SHIFT);
+
+	// Walk up from the ending tag of the block above to "end_region"
+	for(tb = hint_tag - 1; (char *) tb != region_base; tb--) {
+		tb = tb - (tb->size / 16) - 1;
+		if(tb->tag == 0 && tb->size >= req_amt) { up = tb; break; }
+		if((char *) tb < lo) break;
+	}
+	// Walk down from the top tag of the block below to "top_region"
+	for(tb = hint_end + 1; tb != region_top && (char *) tb < hi; tb += (tb->size / 16) + 2) {
+		if(tb->tag == 0 && tb->size >= req_amt) { down = tb; break; }
+	}
+
+	if(up != NULL && (down == NULL ||
+	    (char *) hint_tag - (char *) (up + up->size / 16 + 2) <= (char *) down - (char *) hint_end)) {
+		// Bottom of the block above, or all of it if the rest is too small
+		payload = (char *) (up + 1);
+		user = payload + up->size - req_amt;
+		if(user != payload && user - payload < 48) user = payload;
+	} else if(down != NULL) {
+		payload = (char *) (down + 1);
+		user = payload;
+	} else {
+		near_misses++;
+		return alloc_mem(amount);
+	}
+	entry = fi_find((struct free_block *) payload);
+	if(entry < 0) return alloc_mem(amount);
+	near_hits++;
+	return carve_block(entry, user, req_amt);
+}
+
+
+/* void *alloc_mem_life( unsigned int amount, int life )
+ *
+ * input parameters
+ *   amount is the number of bytes requested
+ *   life is LIFE_SHORT, LIFE_LONG or LIFE_AUTO, the expected lifetime
+ *   of the block
+ *
+ * return value
+ *   a pointer to the allocated block, or NULL as for alloc_mem()
+ *
+ * description
+ *   alloc_mem_life() gives LIFE_SHORT blocks to alloc_mem() and puts
+ *   LIFE_LONG blocks at the top of the lowest free block that fits;
+ *   LIFE_AUTO takes the class learned for the size (see lifetime
+ *   classes above).
+ */
+
+void *alloc_mem_life( unsigned int amount, int life ){
+	unsigned int req_amt;
+	int entry;
+
+	if(amount == 0) return NULL;
+	req_amt = ((amount + 15) / 16) * 16;
+	if(life == LIFE_AUTO)
+		life = (life_learning && life_long[life_class(req_amt)]) ? LIFE_LONG : LIFE_SHORT;
+	if(life != LIFE_LONG || region_mode == REGION_RESERVE || region_mode == REGION_BUDDY)
+		return alloc_mem(amount);
+
+	// Take the top of the lowest free block that fits
+	entry = life_search_low(req_amt);
+	if(entry < 0) return NULL;
+	return carve_block(entry, region_base + fi_offset[entry], req_amt);
+}
+
+
 /* Step through the free list and count block sizes
  */
 int free_size() {
+	if (engine_free_size != NULL) return engine_free_size();
+
 	// if list is full return 0
 	if (free_list == NULL) return 0;
 	if (free_list == free_list->fwd_link) return 0;
@@ -427,6 +3193,10 @@ int free_size() {
  *      tag block of the block below (so that signature checks
  *      will fail if a dangling pointer is later used)
  *
+ *   If the merged free block is large enough for a caller
+ *   parked in alloc_mem_wait() (or one of its non-blocking
+ *   forms), those waiters that it can satisfy are woken.
+ *
  *   Invalid pointers are detected by performing a signature
  *   check on the tag block just above the pointer. Invalid
  *   pointers result in a nonzero return code (value of 1),
@@ -448,24 +3218,35 @@ int free_size() {
 
 unsigned int release_mem( void *ptr ){
 
+	LAT_HOOK_RELEASE(ptr)
+	alloc_stats.releases++;
+
 	// Check for bad pointer
 	if(ptr == NULL) return 1;
+	if(__builtin_expect(engine_release != NULL, 0)) return engine_release(ptr);
 
 	int coalesce_lower = 0, coalesce_upper = 0;
+	unsigned int merged;
 	struct free_block *f_ptr = (struct free_block *)ptr;
 	struct tag_block *tag_ptr = (struct tag_block *)ptr - 1;
 	struct tag_block *end_ptr = tag_ptr + 1 + (tag_ptr->size / 16);
 
 	if((void *)tag_ptr == (void *)free_list) return 1;
+	if(strncmp(tag_ptr->sig, "top_alcblk", 10) != 0) return 1;
 	if(tag_ptr->tag != 1 || end_ptr->tag != 1) return 1; 
 	if(tag_ptr->size == 0 || end_ptr->size == 0) return 1;
 
+	// A sampled block leaves the heap profile
+	if(end_ptr->sig[4] == 's') prof_forget(ptr);
+	if(__builtin_expect(life_learning, 0)) life_note_release(tag_ptr->size);
+
 	// Check upper and lower blocks
 	coalesce_lower = (end_ptr + 1)->tag == 0 ? 1 : 0;
 	coalesce_upper = (tag_ptr - 1)->tag == 0 ? 1 :  0;
 
 	// Case 1: No coalesce
 	if(!coalesce_lower && !coalesce_upper) {
+		alloc_stats.release_case[0]++;
 		// Reset tag block status
 		tag_ptr->tag = 0;
 		end_ptr->tag = 0;
@@ -476,6 +3257,8 @@ unsigned int release_mem( void *ptr ){
 		f_ptr->back_link = free_list;
 		f_ptr->fwd_link = temp_ptr;
 		f_ptr->fwd_link->back_link = f_ptr;
+		fi_insert(f_ptr, tag_ptr->size);
+		merged = tag_ptr->size;
 
 		strcpy(tag_ptr->sig, "top_memblk");
 		strcpy(end_ptr->sig, "end_memblk");
@@ -483,6 +3266,7 @@ unsigned int release_mem( void *ptr ){
 	}
 	// Case 2: Coalesce with upper
 	else if(!coalesce_lower && coalesce_upper) {
+		alloc_stats.release_case[1]++;
 	
 		struct tag_block *upper_lower_tag = tag_ptr - 1;
 		struct tag_block *top_tag = upper_lower_tag - (upper_lower_tag->size / 16) - 1;
@@ -492,13 +3276,18 @@ unsigned int release_mem( void *ptr ){
 
 		top_tag->size += tag_ptr->size + 2 * sizeof(struct tag_block);
 		end_ptr->size = top_tag->size;
+		fi_resize(fi_lookup((struct free_block *)(top_tag + 1)), top_tag->size);
+		merged = top_tag->size;
 
 		strcpy(top_tag->sig, "top_memblk");
 		strcpy(end_ptr->sig, "end_memblk");
+		strcpy(upper_lower_tag->sig, "old_end_mb");
+		strcpy(tag_ptr->sig, "old_top_mb");
 
 	}
 	// Case 3: Coalesce with lower
 	else if(coalesce_lower && !coalesce_upper) {
+		alloc_stats.release_case[2]++;
 
 		struct tag_block *lower_upper_tag = end_ptr + 1;
 		struct tag_block *bottom_tag = lower_upper_tag + (lower_upper_tag->size / 16) + 1;
@@ -515,15 +3304,22 @@ unsigned int release_mem( void *ptr ){
 		f_ptr->back_link = bottom_block->back_link;
 		f_ptr->back_link->fwd_link = f_ptr;
 
+		int entry = fi_lookup(bottom_block);
+		fi_move(entry, f_ptr);
+		fi_resize(entry, tag_ptr->size);
+		merged = tag_ptr->size;
+
 		strcpy(tag_ptr->sig, "top_memblk");
 		strcpy(bottom_tag->sig, "end_memblk");
+		strcpy(end_ptr->sig, "old_end_mb");
+		strcpy(lower_upper_tag->sig, "old_top_mb");
 
 	}
 	// Case 4: Coalesce with upper and lower
 	else {
+		alloc_stats.release_case[3]++;
 		struct tag_block *upper_lower_tag = tag_ptr - 1;
 		struct tag_block *top_tag = upper_lower_tag - (upper_lower_tag->size / 16) - 1;
-		struct free_block *top_block = (struct free_block *)(top_tag + 1);
 
 		struct tag_block *lower_upper_tag = end_ptr + 1;
 		struct tag_block *bottom_tag = lower_upper_tag + (lower_upper_tag->size / 16) + 1;
@@ -532,18 +3328,317 @@ unsigned int release_mem( void *ptr ){
 		top_tag->size += bottom_tag->size + tag_ptr->size +  4 * sizeof(struct tag_block);
 		bottom_tag->size = top_tag->size;
 
-		top_block->fwd_link = bottom_block->fwd_link;
-		top_block->fwd_link->back_link = top_block;
+		// Remove the node for the bottom block wherever it is in the list
+		bottom_block->back_link->fwd_link = bottom_block->fwd_link;
+		bottom_block->fwd_link->back_link = bottom_block->back_link;
+
+		fi_resize(fi_lookup((struct free_block *)(top_tag + 1)), top_tag->size);
+		fi_remove(fi_lookup(bottom_block));
+		merged = top_tag->size;
 
 		strcpy(top_tag->sig, "top_memblk");
 		strcpy(bottom_tag->sig, "end_memblk");
+		strcpy(upper_lower_tag->sig, "old_end_mb");
+		strcpy(tag_ptr->sig, "old_top_mb");
+		strcpy(end_ptr->sig, "old_end_mb");
+		strcpy(lower_upper_tag->sig, "old_top_mb");
 
 	}
+	// Wake only the waiters that the merged block can satisfy
+	if(__builtin_expect(merged >= wait_min, 0)) wait_wake(merged);
+
 	// Return status integer
 	return 0;
 }
 
 
+/* tiny object tier
+ *
+ * Requests of up to TINY_MAX bytes are served from sub-areas that use
+ * the block format of simple_alloc.c: a status byte and a size byte at
+ * each end of the payload, so a tiny object costs 4 bytes of control
+ * fields instead of the 32 bytes of tag blocks used by alloc_mem().
+ * Larger requests go to alloc_mem().
+ *
+ * Each sub-area is an alloc_mem_aligned() block of TINY_AREA_SIZE
+ * bytes aligned to TINY_AREA_SIZE, so tiny_release() finds the owning
+ * sub-area by masking the user pointer. A sub-area starts with a
+ * header holding the signature "tiny_area", a count of live objects,
+ * and the links of the list of sub-areas:
+ *
+ *      =============  aligned to TINY_AREA_SIZE
+ *      | signature |   12 bytes = "tiny_area"
+ *      | live      |    4 bytes, objects allocated in this sub-area
+ *      | next      |    8 bytes
+ *      | prev      |    8 bytes
+ *      +-----------+
+ *      | status    |    1 byte, 0 if free, 1 when allocated
+ *      | size      |    1 byte, payload size (at most 255)
+ *      | payload   |
+ *      | size      |
+ *      | status    |
+ *      +-----------+
+ *        ...          more blocks to the end of the sub-area
+ *      =============
+ *
+ * Tiny objects are placed first fit within the first sub-area that can
+ * hold them; released tiny objects are coalesced with free neighbours
+ * as long as the merged payload still fits in the size byte, and a
+ * sub-area that becomes empty is handed back to release_mem() unless
+ * it is the last one. Tiny payloads are byte aligned, as in
+ * simple_alloc.c.
+ *
+ * tiny_release() has to tell tiny objects from other blocks without
+ * trusting the bytes at the masked address, which may be user data of
+ * another block or, with REGION_RESERVE, uncommitted memory. tiny_map
+ * has one bit per TINY_AREA_SIZE slot of the region, set while a
+ * sub-area starts there, and is consulted before the sub-area is read.
+ */
+
+#define TINY_MAX 255
+#ifndef TINY_AREA_SIZE
+#define TINY_AREA_SIZE 4096
+#endif
+#define TINY_MIN_BLOCK 6
+
+struct tiny_area {
+  char sig[12];
+  unsigned int live;
+  struct tiny_area *next, *prev;
+};
+struct tiny_area *tiny_list = NULL;
+unsigned char *tiny_map = NULL;
+
+/* block field macros in the style of simple_macros.c, based on tb_ptr */
+#define TB_STATUS (*(tb_ptr))
+#define TB_SIZE (*(tb_ptr+1))
+#define TB_BOTTOM_SIZE (*(tb_ptr+TB_SIZE+2))
+#define TB_BOTTOM_STATUS (*(tb_ptr+TB_SIZE+3))
+#define TB_NEXT (tb_ptr+TB_SIZE+4)
+#define TINY_FIRST(ta) ((unsigned char *)((ta)+1))
+#define TINY_END(ta) ((unsigned char *)(ta)+TINY_AREA_SIZE)
+#define TINY_SLOT(ta) (((char *)(ta) - region_base) / TINY_AREA_SIZE)
+#define TINY_MAP_SET(ta) (tiny_map[TINY_SLOT(ta) / 8] |= 1 << (TINY_SLOT(ta) % 8))
+#define TINY_MAP_CLEAR(ta) (tiny_map[TINY_SLOT(ta) / 8] &= ~(1 << (TINY_SLOT(ta) % 8)))
+#define TINY_MAP_TEST(ta) (tiny_map[TINY_SLOT(ta) / 8] & (1 << (TINY_SLOT(ta) % 8)))
+
+/* forget the sub-areas of a region that is given back */
+
+void tiny_reset(){
+  free( tiny_map );
+  tiny_map = NULL;
+  tiny_list = NULL;
+}
+
+struct tiny_area *tiny_new_area(){
+  struct tiny_area *ta;
+  unsigned char *tb_ptr;
+  unsigned int remaining, payload;
+
+  // Start the map with the first sub-area of a region
+  if( tiny_map == NULL ){
+    tiny_map = (unsigned char *) calloc( region_length / TINY_AREA_SIZE / 8 + 1, 1 );
+    if( tiny_map == NULL ) return NULL;
+  }
+  ta = (struct tiny_area *) alloc_mem_aligned( TINY_AREA_SIZE, TINY_AREA_SIZE );
+  if( ta == NULL ) return NULL;
+  TINY_MAP_SET(ta);
+
+  strcpy( ta->sig, "tiny_area" );
+  ta->live = 0;
+  ta->prev = NULL;
+  ta->next = tiny_list;
+  if( tiny_list != NULL ) tiny_list->prev = ta;
+  tiny_list = ta;
+
+  // Carve the sub-area into free blocks of at most TINY_MAX bytes
+  tb_ptr = TINY_FIRST(ta);
+  remaining = TINY_END(ta) - tb_ptr;
+  while( remaining >= TINY_MIN_BLOCK ){
+    payload = remaining - 4;
+    if( payload > TINY_MAX ){
+      payload = TINY_MAX;
+      if( remaining - payload - 4 < TINY_MIN_BLOCK ) payload -= TINY_MIN_BLOCK;
+    }
+    TB_STATUS = 0;
+    TB_SIZE = payload;
+    TB_BOTTOM_SIZE = payload;
+    TB_BOTTOM_STATUS = 0;
+    remaining -= payload + 4;
+    tb_ptr = TB_NEXT;
+  }
+  return ta;
+}
+
+unsigned char *tiny_alloc_block( struct tiny_area *ta, unsigned int amount ){
+  unsigned char *tb_ptr = TINY_FIRST(ta);
+  unsigned int remaining;
+
+  while( tb_ptr < TINY_END(ta) ){
+    if( TB_STATUS == 0 && TB_SIZE >= amount ){
+      if( TB_SIZE - amount >= TINY_MIN_BLOCK ){
+        // Split off the bottom of the block as a new free block
+        remaining = TB_SIZE - amount - 4;
+        TB_BOTTOM_SIZE = remaining;
+        TB_SIZE = amount;
+        TB_BOTTOM_SIZE = amount;
+        *(TB_NEXT) = 0;
+        *(TB_NEXT + 1) = remaining;
+      }
+      TB_STATUS = 1;
+      TB_BOTTOM_STATUS = 1;
+      ta->live++;
+      return ( tb_ptr + 2 );
+    }
+    tb_ptr = TB_NEXT;
+  }
+  return NULL;
+}
+
+/* return the sub-area owning ptr, or NULL if ptr is not a tiny object */
+
+struct tiny_area *tiny_owner( void *ptr ){
+  struct tiny_area *ta;
+  struct tag_block *tag_ptr;
+
+  ta = (struct tiny_area *) ((uintptr_t) ptr & ~(uintptr_t) (TINY_AREA_SIZE - 1));
+  if( (char *) ta < region_base + 32 || (char *) ta >= (char *) free_list ) return NULL;
+  if( (unsigned char *) ptr < TINY_FIRST(ta) + 2 ) return NULL;
+  if( tiny_map == NULL || !TINY_MAP_TEST(ta) ) return NULL;
+  tag_ptr = ((struct tag_block *) ta) - 1;
+  if( tag_ptr->tag != 1 || strcmp( ta->sig, "tiny_area" ) != 0 ) return NULL;
+  return ta;
+}
+
+
+/* void *tiny_alloc( unsigned int amount )
+ *
+ *   returns a tiny object for requests of up to TINY_MAX bytes, and
+ *   otherwise (or when no sub-area can be added) the result of
+ *   alloc_mem(); a request for zero bytes returns NULL
+ *
+ * unsigned int tiny_release( void *ptr )
+ *
+ *   releases a pointer returned by tiny_alloc(), passing pointers that
+ *   are not tiny objects on to release_mem(); returns 0 for valid
+ *   pointers and 1 for invalid ones, as release_mem() does
+ */
+
+void *tiny_alloc( unsigned int amount ){
+	struct tiny_area *ta;
+	unsigned char *p;
+
+	if(amount == 0) return NULL;
+	if(amount > TINY_MAX) return alloc_mem(amount);
+
+	for(ta = tiny_list; ta != NULL; ta = ta->next) {
+		p = tiny_alloc_block(ta, amount);
+		if(p != NULL) return p;
+	}
+
+	ta = tiny_new_area();
+	if(ta == NULL) return alloc_mem(amount);
+	return tiny_alloc_block(ta, amount);
+}
+
+unsigned int tiny_release( void *ptr ){
+	struct tiny_area *ta;
+	unsigned char *tb_ptr, *prev_ptr, *next_ptr;
+
+	if(ptr == NULL) return 1;
+	ta = tiny_owner(ptr);
+	if(ta == NULL) return release_mem(ptr);
+
+	tb_ptr = (unsigned char *) ptr - 2;
+	if(TB_STATUS != 1 || TB_BOTTOM_STATUS != 1) return 1;
+	TB_STATUS = 0;
+	TB_BOTTOM_STATUS = 0;
+	ta->live--;
+
+	// Coalesce with the block below while the size byte can hold it
+	next_ptr = TB_NEXT;
+	if(next_ptr < TINY_END(ta) && *next_ptr == 0 &&
+	   TB_SIZE + *(next_ptr + 1) + 4 <= TINY_MAX) {
+		TB_SIZE += *(next_ptr + 1) + 4;
+		TB_BOTTOM_SIZE = TB_SIZE;
+	}
+
+	// Coalesce with the block above while the size byte can hold it
+	if(tb_ptr > TINY_FIRST(ta) && *(tb_ptr - 1) == 0) {
+		prev_ptr = tb_ptr - *(tb_ptr - 2) - 4;
+		if(*(prev_ptr + 1) + TB_SIZE + 4 <= TINY_MAX) {
+			*(prev_ptr + 1) += TB_SIZE + 4;
+			tb_ptr = prev_ptr;
+			TB_BOTTOM_SIZE = TB_SIZE;
+		}
+	}
+
+	// Hand an empty sub-area back unless it is the only one
+	if(ta->live == 0 && (ta->prev != NULL || ta->next != NULL)) {
+		if(ta->prev != NULL) ta->prev->next = ta->next;
+		else tiny_list = ta->next;
+		if(ta->next != NULL) ta->next->prev = ta->prev;
+		strcpy(ta->sig, "old_tiny");
+		TINY_MAP_CLEAR(ta);
+		release_mem(ta);
+	}
+	return 0;
+}
+
+
+#ifndef BENCH
+
+/* two call sites for the heap profiler test */
+
+__attribute__ ((noinline)) void *small_site( void ){ return alloc_mem( 64 ); }
+__attribute__ ((noinline)) void *large_site( void ){ return alloc_mem( 20000 ); }
+
+/* a producer and a callback for the blocking allocation test */
+
+void *wait_producer( void *arg ){
+  *(void **) arg = alloc_mem_wait( 0x2800, -1 );
+  return NULL;
+}
+
+void wait_callback( void *ptr, void *arg ){
+  *(void **) arg = ptr;
+}
+
+/* drop a slice from another thread */
+
+void *buf_dropper( void *arg ){
+  buf_drop( (struct buf_slice *) arg );
+  return NULL;
+}
+
+/* readers for the epoch reclamation test: walk a list of nodes and
+ * count nodes whose top tag says they have been released */
+
+struct epoch_node { struct epoch_node *next; unsigned int key; };
+struct epoch_node *epoch_list;
+int epoch_stop;
+
+void *epoch_holder( void *arg ){
+  epoch_enter();
+  while( !__atomic_load_n( &epoch_stop, __ATOMIC_ACQUIRE ) ) usleep(1000);
+  epoch_exit();
+  return arg;
+}
+
+void *epoch_reader( void *arg ){
+  struct epoch_node *p;
+  unsigned long *bad = (unsigned long *) arg;
+
+  while( !__atomic_load_n( &epoch_stop, __ATOMIC_ACQUIRE ) ){
+    epoch_enter();
+    for( p = __atomic_load_n( &epoch_list, __ATOMIC_ACQUIRE ); p != NULL;
+         p = __atomic_load_n( &p->next, __ATOMIC_ACQUIRE ) )
+      if( ( (struct tag_block *) p - 1 )->tag != 1 ) ( *bad )++;
+    epoch_exit();
+  }
+  return NULL;
+}
+
 int main(){
   void *ptr[20];
   unsigned int rc;
@@ -625,9 +3720,471 @@ int main(){
   ptr[17] = alloc_mem(0x20);
   if(ptr[17]==NULL) printf("*** alloc_mem() returns NULL\n");
   prt_free_list();
+  prt_alloc_stats();
+
+  printf("new region of 0x4000 for aligned and tiny allocation\n");
+  release_region();
+  init_region_size(0x4000);
+  ptr[0] = alloc_mem_aligned(0x100, 0x1000);
+  if(ptr[0]==NULL) printf("ptr[0] gets NULL\n");
+  if(((uintptr_t)ptr[0] & 0xfff) != 0) printf("*** ptr[0] is not aligned\n");
+  ptr[1] = alloc_mem_aligned(0x40, 0x40);
+  if(ptr[1]==NULL) printf("ptr[1] gets NULL\n");
+  if(((uintptr_t)ptr[1] & 0x3f) != 0) printf("*** ptr[1] is not aligned\n");
+  rc=release_mem(ptr[0]); if(rc) printf("*** release_mem() fails\n");
+  rc=release_mem(ptr[1]); if(rc) printf("*** release_mem() fails\n");
+  prt_free_list();
+
+  printf("alloc 140 objects of 24 bytes, tiny and regular\n");
+  {
+    void *obj[140];
+    int i, used;
+    for(i = 0; i < 140; i++) obj[i] = tiny_alloc(24);
+    used = 0x4000 - free_size();
+    printf("tiny tier uses %d bytes, %d per object\n", used, used / 140);
+    for(i = 0; i < 140; i++){
+      rc=tiny_release(obj[i]); if(rc) printf("*** tiny_release() fails\n");
+    }
+    rc=tiny_release(obj[0]);
+    if(rc) printf("re-release of tiny object fails\n");
+    used = free_size();
+    for(i = 0; i < 140; i++) obj[i] = alloc_mem(24);
+    used -= free_size();
+    printf("alloc_mem uses %d bytes, %d per object\n", used, used / 140);
+    for(i = 0; i < 140; i++){
+      rc=tiny_release(obj[i]); if(rc) printf("*** tiny_release() fails\n");
+    }
+    // user data that looks like a sub-area header is not taken for one
+    {
+      char *big = (char *) alloc_mem(0x2000);
+      char *fake = (char *) (((uintptr_t) big + TINY_AREA_SIZE - 1) & ~(uintptr_t) (TINY_AREA_SIZE - 1));
+      ((struct tag_block *) fake - 1)->tag = 1;
+      strcpy(fake, "tiny_area");
+      rc=tiny_release(fake + 0x40);
+      if(rc) printf("forged sub-area header is rejected\n");
+      rc=release_mem(big); if(rc) printf("*** release_mem() fails\n");
+    }
+  }
+  prt_free_list();
+
+  printf("new region of 8 MiB backed by huge pages\n");
+  release_region();
+  init_region_mode(8 * 1024 * 1024 - 80, REGION_HUGEPAGE);
+  ptr[0] = alloc_mem(0x100); if(ptr[0]==NULL) printf("ptr[0] gets NULL\n");
+  ptr[1] = alloc_mem(0x300000); if(ptr[1]==NULL) printf("ptr[1] gets NULL\n");
+  ptr[2] = alloc_mem(0x100); if(ptr[2]==NULL) printf("ptr[2] gets NULL\n");
+  prt_free_list();
+  if(ptr[1]!=NULL) memset(ptr[1], 1, 0x300000);
+  prt_huge_coverage();
+
+  printf("new region of 64 MiB reserved and committed on demand\n");
+  release_region();
+  init_region_mode(64 * 1024 * 1024, REGION_RESERVE);
+  printf("   %lu kB committed\n", (unsigned long) region_committed() / 1024);
+  ptr[0] = alloc_mem(0x100); if(ptr[0]==NULL) printf("ptr[0] gets NULL\n");
+  ptr[1] = alloc_mem(0x100000); if(ptr[1]==NULL) printf("ptr[1] gets NULL\n");
+  ptr[2] = alloc_mem_aligned(0x1000, 0x1000); if(ptr[2]==NULL) printf("ptr[2] gets NULL\n");
+  if(ptr[1]!=NULL) memset(ptr[1], 1, 0x100000);
+  printf("   %lu kB committed after 3 allocations\n", (unsigned long) region_committed() / 1024);
+  prt_free_list();
+  rc=release_mem(ptr[1]); if(rc) printf("*** release_mem() fails\n");
+  ptr[3] = alloc_mem(0x3000000); if(ptr[3]==NULL) printf("ptr[3] gets NULL\n");
+  printf("   %lu kB committed after alloc 0x3000000\n", (unsigned long) region_committed() / 1024);
+  prt_huge_coverage();
+  prefault_region(4);
+  printf("prefault with 4 threads\n");
+  prt_huge_coverage();
+
+  printf("heap profile of 8000 small and 100 large allocations, sampling every 4096 bytes\n");
+  release_region();
+  init_region_size(0x400000);
+  prof_start(4096);
+  {
+    static void *small[8000];
+    void *large[100];
+    FILE *fp;
+    char line[128];
+    int i;
+    for(i = 0; i < 8000; i++) small[i] = small_site();
+    for(i = 0; i < 100; i++) large[i] = large_site();
+    for(i = 0; i < 8000; i += 2){
+      rc=release_mem(small[i]); if(rc) printf("*** release_mem() fails\n");
+    }
+    // the profile is kept only in the file named by ALLOC_PROFILE
+    fp = (getenv("ALLOC_PROFILE") != NULL) ? fopen(getenv("ALLOC_PROFILE"), "w+") : tmpfile();
+    if(fp != NULL){
+      prof_dump(fp);
+      rewind(fp);
+      if(fgets(line, sizeof(line), fp) != NULL) printf("   %s", line);
+      fclose(fp);
+    }
+    (void) large;
+  }
+  prof_start(0);
+
+  printf("fragmentation snapshots of 1 MiB during random alloc/release\n");
+  release_region();
+  init_region_size(0x100000);
+  {
+    static void *live[2000];
+    unsigned int i, s, seed = 12345;
+    // the snapshots are kept only in the file named by ALLOC_FRAGMAP
+    const char *map_name = getenv("ALLOC_FRAGMAP");
+    FILE *fp = (map_name != NULL) ? fopen(map_name, "wb") : tmpfile();
+    for(i = 0; i < 2000; i++) live[i] = NULL;
+    for(i = 0; i < 80000 && fp != NULL; i++){
+      seed = seed * 1103515245 + 12345;
+      s = (seed >> 8) % 2000;
+      if(live[s] != NULL){
+        rc=release_mem(live[s]); if(rc) printf("*** release_mem() fails\n");
+      }
+      // sizes grow over time, so old holes become too small to reuse
+      live[s] = alloc_mem(16 + (seed >> 12) % (64 + i / 160));
+      if(i % 10000 == 9999) frag_dump(fp);
+    }
+    if(fp != NULL){
+      fclose(fp);
+      printf("   %u snapshots written to %s\n", frag_sequence,
+        (map_name != NULL) ? map_name : "a temporary file");
+    }
+
+    printf("verify the fragmented heap with 4 threads\n");
+    verify_heap(4);
+    printf("churn again with 8 blocks verified per alloc_mem call\n");
+    verify_incremental(8);
+    for(i = 0; i < 20000; i++){
+      seed = seed * 1103515245 + 12345;
+      s = (seed >> 8) % 2000;
+      if(live[s] != NULL){
+        rc=release_mem(live[s]); if(rc) printf("*** release_mem() fails\n");
+      }
+      live[s] = alloc_mem(16 + (seed >> 12) % 600);
+    }
+    verify_incremental(0);
+    printf("   %lu full passes, %lu problems\n", verify_passes, verify_errors);
+    printf("corrupt the ending tag of one block - logical error\n");
+    if(live[7] != NULL){
+      struct tag_block *tb = (struct tag_block *) live[7] - 1;
+      struct tag_block *end = tb + tb->size / 16 + 1;
+      end->size += 16;
+      verify_heap(4);
+      end->size -= 16;
+    }
+  }
+
+  printf("blocking allocation on a full 64 KiB region\n");
+  release_region();
+  init_region_size(0x10000);
+  {
+    void *blk[32], *got = NULL;
+    pthread_t producer;
+    eventfd_t count;
+    int i, n, fd;
+    for(n = 0; n < 32 && (blk[n] = alloc_mem(0x1000)) != NULL; n++);
+    printf("   %d blocks of 0x1000 fill the region\n", n);
+    if(alloc_mem_wait(0x1000, 0) == NULL) printf("   try without waiting gets NULL\n");
+    if(alloc_mem_wait(0x3000, 20) == NULL) printf("   wait of 20 ms times out\n");
+    pthread_create(&producer, NULL, wait_producer, &got);
+    usleep(50000);
+    release_mem_locked(blk[0]);
+    release_mem_locked(blk[2]);
+    printf("   2 separate blocks freed, %lu waiters woken\n", wait_woken);
+    release_mem_locked(blk[1]);
+    pthread_join(producer, NULL);
+    printf("   3 coalesced blocks freed, %lu waiters woken, 0x2800 %s\n",
+      wait_woken, got != NULL ? "allocated" : "gets NULL");
+
+    fd = eventfd(0, EFD_NONBLOCK);
+    alloc_mem_eventfd(0x1800, fd);
+    release_mem_locked(blk[4]);
+    printf("   eventfd for 0x1800 %s after 1 block freed\n",
+      eventfd_read(fd, &count) == 0 ? "signaled" : "not signaled");
+    release_mem_locked(blk[5]);
+    printf("   eventfd for 0x1800 %s after 2 blocks freed\n",
+      eventfd_read(fd, &count) == 0 ? "signaled" : "not signaled");
+    got = alloc_mem_locked(0x1800);
+    if(got == NULL) printf("   0x1800 gets NULL\n");
+    close(fd);
+
+    got = NULL;
+    alloc_mem_notify(0x1800, wait_callback, &got);
+    release_mem_locked(blk[7]);
+    release_mem_locked(blk[8]);
+    printf("   callback for 0x1800 %s\n", got != NULL ? "got its block" : "not called");
+    printf("   %lu parked, %lu woken, %lu timed out, %lu requeued\n",
+      wait_parked, wait_woken, wait_timeouts, wait_requeued);
+    for(i = 9; i < n; i++) release_mem_locked(blk[i]);
+  }
+
+  printf("asynchronous release of 2000 blocks of a 1 MiB region\n");
+  release_region();
+  init_region_size(0x100000);
+  {
+    static void *blk[2000];
+    struct async_stats as;
+    int i;
+    for(i = 0; i < 2000; i++) blk[i] = alloc_mem(16 + i % 400);
+    for(i = 0; i < 2000; i += 2){
+      rc=release_mem_async(blk[i]); if(rc) printf("*** release_mem_async() fails\n");
+    }
+    rc=release_mem_async(blk[0]);
+    if(rc) printf("re-release of a queued block fails\n");
+    get_async_stats(&as);
+    printf("   %lu queued, %lu released before the reclaimer starts\n", as.depth, as.released);
+    verify_heap(1);
+    async_start(1000);
+    for(i = 1; i < 2000; i += 2){
+      rc=release_mem_async(blk[i]); if(rc) printf("*** release_mem_async() fails\n");
+    }
+    usleep(20000);
+    async_stop();
+    get_async_stats(&as);
+    printf("   %lu queued, %lu released (%lu invalid) in %lu drains\n",
+      as.depth, as.released, as.invalid, as.drains);
+    printf("   reclaim lag: mean %lu us, max %lu us\n", as.lag_avg_ns / 1000, as.lag_max_ns / 1000);
+    prt_free_list();
+
+    printf("synchronous reclaim once a thread has 64 blocks queued\n");
+    async_sync_depth = 64;
+    for(i = 0; i < 100; i++) blk[i] = alloc_mem(0x100);
+    for(i = 0; i < 100; i++) release_mem_async(blk[i]);
+    get_async_stats(&as);
+    printf("   %lu queued, %lu synchronous drains\n", as.depth, as.sync_drains);
+    async_sync_depth = 0;
+    async_reclaim();
+  }
+
+  printf("epoch reclamation of nodes unlinked from a list\n");
+  release_region();
+  init_region_size(0x100000);
+  {
+    struct epoch_node *p, *q, **prev;
+    pthread_t reader[2];
+    unsigned long bad[2] = {0, 0};
+    unsigned int i, k, seed = 12345;
+
+    epoch_stop = 0;
+    pthread_create(&reader[0], NULL, epoch_holder, NULL);
+    usleep(20000);
+    for(i = 0; i < 200; i++){
+      p = (struct epoch_node *) alloc_mem_locked(sizeof(struct epoch_node));
+      retire_mem(p);
+    }
+    printf("   %lu retired, %lu released while a reader is inside\n", epoch_retired, epoch_released);
+    __atomic_store_n(&epoch_stop, 1, __ATOMIC_RELEASE);
+    pthread_join(reader[0], NULL);
+    epoch_flush();
+    printf("   %lu retired, %lu released after it leaves\n", epoch_retired, epoch_released);
+
+    epoch_list = NULL;
+    for(i = 0; i < 100; i++){
+      p = (struct epoch_node *) alloc_mem_locked(sizeof(struct epoch_node));
+      p->key = i;
+      p->next = epoch_list;
+      epoch_list = p;
+    }
+    epoch_stop = 0;
+    for(k = 0; k < 2; k++) pthread_create(&reader[k], NULL, epoch_reader, &bad[k]);
+    // replace random nodes while two readers walk the list
+    for(i = 0; i < 50000; i++){
+      seed = seed * 1103515245 + 12345;
+      for(prev = &epoch_list, k = (seed >> 8) % 100; k > 0; k--) prev = &(*prev)->next;
+      p = *prev;
+      q = (struct epoch_node *) alloc_mem_locked(sizeof(struct epoch_node) + (seed >> 12) % 64);
+      q->key = p->key;
+      q->next = p->next;
+      __atomic_store_n(prev, q, __ATOMIC_RELEASE);
+      rc=retire_mem(p); if(rc) printf("*** retire_mem() fails\n");
+    }
+    __atomic_store_n(&epoch_stop, 1, __ATOMIC_RELEASE);
+    for(k = 0; k < 2; k++) pthread_join(reader[k], NULL);
+    epoch_flush();
+    printf("   50000 replacements: %lu retired, %lu released, %lu released nodes seen by readers\n",
+      epoch_retired, epoch_released, bad[0] + bad[1]);
+    for(p = epoch_list; p != NULL; p = q){
+      q = p->next;
+      release_mem(p);
+    }
+  }
+
+  printf("reference-counted buffer sliced and written with writev\n");
+  release_region();
+  init_region_size(0x4000);
+  {
+    struct buf_slice pkt, part[3];
+    struct iovec iov[3];
+    pthread_t dropper[3];
+    char back[1500];
+    int pipefd[2], n, i, before = free_size();
+
+    pkt = buf_alloc(1500);
+    for(i = 0; i < 1500; i++) buf_data(pkt)[i] = (char) i;
+    part[0] = buf_slice(pkt, 0, 20);
+    part[1] = buf_slice(pkt, 20, 1000);
+    part[2] = buf_slice(pkt, 1020, 1000);
+    printf("   3 slices hold %u references\n", pkt.buf->refs);
+    buf_drop(&pkt);
+    n = buf_iovec(part, 3, iov);
+    if(pipe(pipefd) == 0){
+      i = writev(pipefd[1], iov, n);
+      if(i > 0 && read(pipefd[0], back, sizeof(back)) == i)
+        printf("   writev of %d slices sends %d bytes, %s\n", n, i,
+          memcmp(back, buf_data(part[0]), 1500) == 0 ? "unchanged" : "changed");
+      close(pipefd[0]);
+      close(pipefd[1]);
+    }
+    printf("   part[2] is clamped to %u bytes\n", part[2].length);
+    for(i = 0; i < 3; i++) pthread_create(&dropper[i], NULL, buf_dropper, &part[i]);
+    for(i = 0; i < 3; i++) pthread_join(dropper[i], NULL);
+    printf("   %s after the last slice is dropped\n",
+      free_size() == before ? "block released" : "*** block not released");
+  }
+
+  printf("32-bit handles for blocks of the region\n");
+  {
+    unsigned int h = alloc_handle(0x100);
+    void *p = handle_to_ptr(h);
+    printf("   handle 0x%x decodes to offset 0x%lx\n", h, (unsigned long) ((char *) p - region_base));
+    if(ptr_to_handle(p) != h) printf("*** handle does not round trip\n");
+    if(ptr_to_handle((char *) p + 8) == 0) printf("   unaligned pointer has no handle\n");
+    rc=release_handle(h); if(rc) printf("*** release_handle() fails\n");
+    rc=release_handle(h);
+    if(rc) printf("re-release of handle fails\n");
+  }
+
+  printf("allocation near a hint block\n");
+  release_region();
+  init_region_size(0x4000);
+  {
+    char *p[6], *q, *r;
+    int i;
+    for(i = 0; i < 6; i++) p[i] = (char *) alloc_mem(0x100);
+    rc=release_mem(p[1]); if(rc) printf("*** release_mem() fails\n");
+    rc=release_mem(p[4]); if(rc) printf("*** release_mem() fails\n");
+    q = (char *) alloc_mem(0x80);
+    r = (char *) alloc_mem_near(p[0], 0x80);
+    printf("   alloc_mem is 0x%lx bytes from p[0], alloc_mem_near is 0x%lx bytes from it\n",
+      (unsigned long) (p[0] - q), (unsigned long) (p[0] - r));
+    r = (char *) alloc_mem_near(p[5], 0x40);
+    printf("   alloc_mem_near(p[5]) is 0x%lx bytes from p[5]\n", (unsigned long) (p[5] - r));
+    verify_heap(1);
+  }
+  release_region();
+  init_region_size(0x10000);
+  {
+    // a free block whose node is pages away but which ends next to the
+    // hint p[2]; alloc_mem() would take the newer free block of p[0]
+    char *p[5], *r;
+    unsigned int size[5] = { 0x100, 0x3000, 0x100, 0x8000, 0x100 };
+    int i;
+    for(i = 0; i < 5; i++) p[i] = (char *) alloc_mem(size[i]);
+    rc=release_mem(p[3]); if(rc) printf("*** release_mem() fails\n");
+    rc=release_mem(p[0]); if(rc) printf("*** release_mem() fails\n");
+    r = (char *) alloc_mem_near(p[2], 0x40);
+    printf("   free block ending next to p[2] starts 0x%lx bytes away, alloc_mem_near is 0x%lx bytes from p[2]\n",
+      (unsigned long) (p[2] - p[3]), (unsigned long) (r < p[2] ? p[2] - r : r - p[2]));
+    verify_heap(1);
+  }
+
+  printf("lifetime classes\n");
+  release_region();
+  init_region_size(0x4000);
+  {
+    char *s[4], *l[2], *a;
+    int i;
+    life_learn(1);
+    for(i = 0; i < 4; i++) s[i] = (char *) alloc_mem_life(0x200, LIFE_SHORT);
+    l[0] = (char *) alloc_mem_life(0x40, LIFE_LONG);
+    l[1] = (char *) alloc_mem_life(0x40, LIFE_LONG);
+    printf("   short blocks at offsets 0x%lx-0x%lx, long blocks at 0x%lx and 0x%lx\n",
+      (unsigned long) (s[3] - region_base), (unsigned long) (s[0] - region_base),
+      (unsigned long) (l[0] - region_base), (unsigned long) (l[1] - region_base));
+    for(i = 0; i < 4; i++){ rc=release_mem(s[i]); if(rc) printf("*** release_mem() fails\n"); }
+    printf("   largest free block 0x%x after the short blocks are released\n", largest_free());
+    // a size that is allocated often and never released is learned as long-lived
+    for(i = 0; i < LIFE_WINDOW; i++){
+      a = (char *) alloc_mem_life(0x10, LIFE_SHORT);
+      rc=release_mem(a); if(rc) printf("*** release_mem() fails\n");
+    }
+    printf("   0x40 blocks learned as %s, 0x10 blocks as %s\n",
+      life_long[life_class(0x40)] ? "long" : "short", life_long[life_class(0x10)] ? "long" : "short");
+    a = (char *) alloc_mem_life(0x40, LIFE_AUTO);
+    printf("   LIFE_AUTO block of 0x40 at offset 0x%lx\n", (unsigned long) (a - region_base));
+    life_learn(0);
+    verify_heap(1);
+  }
+
+  printf("cache-line isolated blocks\n");
+  release_region();
+  init_region_size(0x4000);
+  {
+    char *c[8];
+    int i, shared = 0;
+    for(i = 0; i < 8; i++) c[i] = (char *) alloc_mem(8);
+    for(i = 1; i < 8; i++) shared += ((uintptr_t) c[i] / CACHE_LINE == (uintptr_t) c[i - 1] / CACHE_LINE);
+    printf("   8 counters from alloc_mem: %d of 7 neighboring pairs share a cache line\n", shared);
+    for(i = 0; i < 8; i++){ rc=release_mem(c[i]); if(rc) printf("*** release_mem() fails\n"); }
+    shared = 0;
+    for(i = 0; i < 8; i++){
+      c[i] = (char *) alloc_mem_isolated(8);
+      if((uintptr_t) c[i] % CACHE_LINE) printf("*** block not on a cache line\n");
+    }
+    for(i = 1; i < 8; i++) shared += ((uintptr_t) c[i] / CACHE_LINE == (uintptr_t) c[i - 1] / CACHE_LINE);
+    printf("   8 counters from alloc_mem_isolated: %d of 7 neighboring pairs share a cache line, blocks of 0x%x bytes\n",
+      shared, ((struct tag_block *) c[0] - 1)->size);
+    for(i = 0; i < 8; i++){ rc=release_mem(c[i]); if(rc) printf("*** release_mem() fails\n"); }
+    verify_heap(1);
+  }
+
+  printf("ring allocation\n");
+  {
+    struct ring *ring = ring_create(0x400, 0);
+    char *m[11], *next;
+    int i, n = 0;
+    for(i = 0; i < 10; i++) m[i] = (char *) ring_alloc(ring, 0x60);
+    for(i = 0; i < 9; i++) ring_commit(ring, m[i]);
+    printf("   %d bytes in use, 10th record %s\n", ring_used(ring), m[9] ? "fits" : "does not fit");
+    rc=ring_free(ring, m[1]); if(rc) printf("*** ring_free() fails\n");
+    printf("   %d bytes in use after the 2nd record is released\n", ring_used(ring));
+    rc=ring_free(ring, m[0]); if(rc) printf("*** ring_free() fails\n");
+    printf("   %d bytes in use after the 1st record is released\n", ring_used(ring));
+    rc=ring_free(ring, m[0]);
+    if(rc) printf("re-release of ring record fails\n");
+    m[10] = (char *) ring_alloc(ring, 0x60);
+    ring_commit(ring, m[10]);
+    for(next = (char *) ring_next(ring, NULL); next != NULL; next = (char *) ring_next(ring, next)) n++;
+    printf("   next record wraps to offset 0x%lx, %d committed records, %lu wraps\n",
+      (unsigned long) (m[10] - ring->data), n, ring->wraps);
+    for(i = 2; i < 11; i++) if(m[i]) ring_free(ring, m[i]);
+    printf("   %d bytes in use after all are released\n", ring_used(ring));
+    ring_destroy(ring);
+    verify_heap(1);
+  }
+
+#ifdef LATENCY
+  printf("latency of 200000 random release/alloc pairs on 4000 live blocks\n");
+  release_region();
+  init_region_size(0x1000000);
+  {
+    void *live[4000];
+    unsigned int i, s, seed = 12345;
+    for(i = 0; i < 4000; i++) live[i] = alloc_mem(16 + i % 1000);
+    lat_enable(1);
+    for(i = 0; i < 200000; i++){
+      seed = seed * 1103515245 + 12345;
+      s = (seed >> 8) % 4000;
+      rc=release_mem(live[s]); if(rc) printf("*** release_mem() fails\n");
+      live[s] = alloc_mem(16 + (seed >> 12) % 2000);
+    }
+    lat_enable(0);
+    lat_report();
+  }
+#endif
   return 0;
 }
 
+#endif
+
 
 /* running this code should produce ouput such as follows
    (note: your starting address and block addresses might differ)
@@ -710,5 +4267,146 @@ alloc 12 blocks and release 5 to create 6 free blocks
    free block at 0x215e730 of size 0x10
    free block at 0x215e9b0 of size 0x10
    --------------end of list--------------
-
+   ---------------alloc stats-------------
+   alloc_mem 25 calls, 2 failed, 17 splits, 6 whole blocks
+   entries scanned 44, 1.8 per call, at most 9
+      scanned <= 1        19
+      scanned <= 2        2
+      scanned <= 4        2
+      scanned <= 8        1
+      scanned <= 16       1
+      size <= 0x10       2
+      size <= 0x20       7
+      size <= 0x40       4
+      size <= 0x80       3
+      size <= 0x100      7
+      size <= 0x400      1
+      size <= 0x800      1
+   internal fragmentation 13 bytes from rounding, 48 from whole blocks
+   release_mem 13 calls, 1 rejected, cases 1-4: 8 1 2 1
+   --------------end of stats-------------
+new region of 0x4000 for aligned and tiny allocation
+data structure starts at 0x558c1725dfb0
+free_list is located at 0x558c17261ff0
+   ---------------free list---------------
+   free block at 0x558c1725dfd0 of size 0x4000
+   --------------end of list--------------
+alloc 140 objects of 24 bytes, tiny and regular
+tiny tier uses 4160 bytes, 29 per object
+re-release of tiny object fails
+alloc_mem uses 8944 bytes, 63 per object
+forged sub-area header is rejected
+   ---------------free list---------------
+   free block at 0x558c1725dfd0 of size 0x2010
+   free block at 0x558c17261020 of size 0xfb0
+   --------------end of list--------------
+new region of 8 MiB backed by huge pages
+data structure starts at 0x7f8e02800000
+free_list is located at 0x7f8e02fffff0
+   ---------------free list---------------
+   free block at 0x7f8e02800020 of size 0x4ffd50
+   --------------end of list--------------
+   region backed by madvise(MADV_HUGEPAGE): 6144 kB resident, 6144 kB in transparent huge pages, 0 kB hugetlb
+new region of 64 MiB reserved and committed on demand
+data structure starts at 0x7f8dff2ac000
+free_list is located at 0x7f8e032ac040
+   68 kB committed
+   1100 kB committed after 3 allocations
+   ---------------free list---------------
+   free block at 0x7f8e031ab020 of size 0xec0
+   free block at 0x7f8dff2ac020 of size 0x3efdfc0
+   --------------end of list--------------
+   50196 kB committed after alloc 0x3000000
+   region backed by reserved range (PROT_NONE): 50204 kB resident, 0 kB in transparent huge pages, 0 kB hugetlb
+prefault with 4 threads
+   region backed by reserved range (PROT_NONE): 65548 kB resident, 0 kB in transparent huge pages, 0 kB hugetlb
+heap profile of 8000 small and 100 large allocations, sampling every 4096 bytes
+data structure starts at 0x7f8e02eac010
+free_list is located at 0x7f8e032ac050
+   heap profile: 171: 1964672 [231: 1968512] @ heap_v2/4096
+fragmentation snapshots of 1 MiB during random alloc/release
+data structure starts at 0x558c172876b0
+free_list is located at 0x558c173876f0
+   8 snapshots written to a temporary file
+verify the fragmented heap with 4 threads
+   verified 2707 blocks (707 free) in 4 slices, 0 problems
+churn again with 8 blocks verified per alloc_mem call
+   52 full passes, 0 problems
+corrupt the ending tag of one block - logical error
+*** verify: ending tag end_alcblk/1/0x70 at 0x558c172c4cb0 does not match top tag
+   verified 2681 blocks (681 free) in 4 slices, 1 problems
+blocking allocation on a full 64 KiB region
+data structure starts at 0x558c1726e8b0
+free_list is located at 0x558c1727e8f0
+   15 blocks of 0x1000 fill the region
+   try without waiting gets NULL
+   wait of 20 ms times out
+   2 separate blocks freed, 0 waiters woken
+   3 coalesced blocks freed, 1 waiters woken, 0x2800 allocated
+   eventfd for 0x1800 not signaled after 1 block freed
+   eventfd for 0x1800 signaled after 2 blocks freed
+   callback for 0x1800 got its block
+   4 parked, 3 woken, 1 timed out, 0 requeued
+asynchronous release of 2000 blocks of a 1 MiB region
+data structure starts at 0x558c17265000
+free_list is located at 0x558c17365040
+re-release of a queued block fails
+   1000 queued, 0 released before the reclaimer starts
+   verified 2001 blocks (1 free) in 1 slices, 0 problems
+   0 queued, 2000 released (0 invalid) in 1 drains
+   reclaim lag: mean 296 us, max 296 us
+   ---------------free list---------------
+   free block at 0x558c17265020 of size 0x100000
+   --------------end of list--------------
+synchronous reclaim once a thread has 64 blocks queued
+   36 queued, 1 synchronous drains
+epoch reclamation of nodes unlinked from a list
+data structure starts at 0x558c17265000
+free_list is located at 0x558c17365040
+   200 retired, 0 released while a reader is inside
+   200 retired, 200 released after it leaves
+   50000 replacements: 50200 retired, 50200 released, 0 released nodes seen by readers
+reference-counted buffer sliced and written with writev
+data structure starts at 0x558c17265000
+free_list is located at 0x558c17269040
+   3 slices hold 4 references
+   writev of 3 slices sends 1500 bytes, unchanged
+   part[2] is clamped to 480 bytes
+   block released after the last slice is dropped
+32-bit handles for blocks of the region
+   handle 0x3f2 decodes to offset 0x3f20
+   unaligned pointer has no handle
+re-release of handle fails
+allocation near a hint block
+data structure starts at 0x558c17265000
+free_list is located at 0x558c17269040
+   alloc_mem is 0x400 bytes from p[0], alloc_mem_near is 0xa0 bytes from it
+   alloc_mem_near(p[5]) is 0x60 bytes from p[5]
+   verified 10 blocks (3 free) in 1 slices, 0 problems
+data structure starts at 0x558c17265000
+free_list is located at 0x558c17275040
+   free block ending next to p[2] starts 0x8020 bytes away, alloc_mem_near is 0x60 bytes from p[2]
+   verified 7 blocks (3 free) in 1 slices, 0 problems
+lifetime classes
+data structure starts at 0x558c17265000
+free_list is located at 0x558c17269040
+   short blocks at offsets 0x37c0-0x3e20, long blocks at 0x20 and 0x80
+   largest free block 0x3f40 after the short blocks are released
+   0x40 blocks learned as long, 0x10 blocks as short
+   LIFE_AUTO block of 0x40 at offset 0xe0
+   verified 4 blocks (1 free) in 1 slices, 0 problems
+cache-line isolated blocks
+data structure starts at 0x558c17265000
+free_list is located at 0x558c17269040
+   8 counters from alloc_mem: 2 of 7 neighboring pairs share a cache line
+   8 counters from alloc_mem_isolated: 0 of 7 neighboring pairs share a cache line, blocks of 0x60 bytes
+   verified 1 blocks (1 free) in 1 slices, 0 problems
+ring allocation
+   1008 bytes in use, 10th record does not fit
+   1008 bytes in use after the 2nd record is released
+   784 bytes in use after the 1st record is released
+re-release of ring record fails
+   next record wraps to offset 0x10, 8 committed records, 1 wraps
+   0 bytes in use after all are released
+   verified 1 blocks (1 free) in 1 slices, 0 problems
 */
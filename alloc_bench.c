@@ -0,0 +1,145 @@
+/* CPSC/ECE 3220 memory allocation benchmark
+ *
+ * This driver is linked with one allocator backend (alloc.c, with
+ * buddy_alloc.c compiled with -DBUDDY_ENGINE for its buddy engine, or
+ * bitmap_alloc.c, all compiled with -DBENCH to leave out their test
+ * drivers) and times alloc_mem() and release_mem() on a fragmented
+ * heap:
+ *
+ *   1) fill LIVE_SLOTS slots with blocks of random size
+ *   2) repeatedly pick a random slot, release its block, and allocate
+ *      a new block of random size in its place
+ *
+ * Sizes are uniform between 16 and MAX_REQUEST + 15 bytes, or with the
+ * argument "pow2", powers of two between 16 and MAX_REQUEST bytes. With
+ * the argument "buddy" the region is built with init_region_mode( size,
+ * REGION_BUDDY ), which alloc.c provides and bitmap_alloc.c does not. At
+ * the end the heap bytes in use (from free_size()) are compared with
+ * the bytes requested by the live blocks, which shows the overhead of
+ * tags and rounding (internal fragmentation).
+ *
+ * Cache misses taken inside alloc_mem() are counted with a hardware
+ * performance counter (perf_event_open(), user mode only) when the
+ * kernel allows it; otherwise that line of the report says so.
+ *
+ * The random sizes and slot choices come from a fixed-seed generator,
+ * so every backend sees the same sequence of requests.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#define REGION_SIZE (32 * 1024 * 1024)
+#define LIVE_SLOTS 20000
+#define OPERATIONS 50000
+#define MAX_REQUEST 1024
+
+#define REGION_BUDDY 3
+
+void init_region_size( unsigned int size );
+void init_region_mode( unsigned int size, int mode ) __attribute__ ((weak));
+void *alloc_mem( unsigned int amount );
+unsigned int release_mem( void *ptr );
+int free_size();
+
+unsigned int bench_seed = 12345;
+
+unsigned int bench_random(){
+  bench_seed = bench_seed * 1103515245 + 12345;
+  return ( bench_seed >> 8 );
+}
+
+int pow2_sizes = 0;
+
+unsigned int bench_size(){
+  if( pow2_sizes ) return 16U << ( bench_random() % 7 );
+  return 16 + bench_random() % MAX_REQUEST;
+}
+
+/* open a counter of cache misses for this thread, or return -1 */
+
+int open_miss_counter(){
+  struct perf_event_attr attr;
+
+  memset( &attr, 0, sizeof( attr ) );
+  attr.type = PERF_TYPE_HARDWARE;
+  attr.size = sizeof( attr );
+  attr.config = PERF_COUNT_HW_CACHE_MISSES;
+  attr.disabled = 1;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  return syscall( __NR_perf_event_open, &attr, 0, -1, -1, 0 );
+}
+
+double elapsed_ns( struct timespec *t0, struct timespec *t1 ){
+  return ( t1->tv_sec - t0->tv_sec ) * 1e9 + ( t1->tv_nsec - t0->tv_nsec );
+}
+
+int main( int argc, char *argv[] ){
+  static void *slot[LIVE_SLOTS];
+  static unsigned int requested[LIVE_SLOTS];
+  struct timespec t0, t1;
+  double alloc_ns = 0, release_ns = 0;
+  unsigned int i, s, failures = 0;
+  unsigned long live_bytes = 0, used_bytes;
+  long long misses = 0;
+  int miss_fd, buddy = 0;
+
+  for( i = 1; i < argc; i++ ){
+    if( strcmp( argv[i], "pow2" ) == 0 ) pow2_sizes = 1;
+    if( strcmp( argv[i], "buddy" ) == 0 ) buddy = 1;
+  }
+
+  if( buddy && init_region_mode == NULL ){ printf( "%s: no buddy engine\n", argv[0] ); return 1; }
+  if( buddy ) init_region_mode( REGION_SIZE, REGION_BUDDY );
+  else init_region_size( REGION_SIZE );
+  miss_fd = open_miss_counter();
+
+  for( i = 0; i < LIVE_SLOTS; i++ ){
+    requested[i] = bench_size();
+    slot[i] = alloc_mem( requested[i] );
+    if( slot[i] == NULL ) failures++;
+  }
+
+  for( i = 0; i < OPERATIONS; i++ ){
+    s = bench_random() % LIVE_SLOTS;
+
+    clock_gettime( CLOCK_MONOTONIC, &t0 );
+    if( slot[s] != NULL ) release_mem( slot[s] );
+    clock_gettime( CLOCK_MONOTONIC, &t1 );
+    release_ns += elapsed_ns( &t0, &t1 );
+
+    requested[s] = bench_size();
+    if( miss_fd >= 0 ) ioctl( miss_fd, PERF_EVENT_IOC_ENABLE, 0 );
+    clock_gettime( CLOCK_MONOTONIC, &t0 );
+    slot[s] = alloc_mem( requested[s] );
+    clock_gettime( CLOCK_MONOTONIC, &t1 );
+    if( miss_fd >= 0 ) ioctl( miss_fd, PERF_EVENT_IOC_DISABLE, 0 );
+    alloc_ns += elapsed_ns( &t0, &t1 );
+    if( slot[s] == NULL ) failures++;
+  }
+
+  for( i = 0; i < LIVE_SLOTS; i++ )
+    if( slot[i] != NULL ) live_bytes += requested[i];
+  used_bytes = REGION_SIZE - free_size();
+
+  printf( "%s%s: %s sizes, %d live blocks, %d operations, %u failed allocations\n",
+    argv[0], buddy ? " buddy" : "", pow2_sizes ? "power-of-two" : "random", LIVE_SLOTS,
+    OPERATIONS, failures );
+  printf( "   alloc_mem   %8.1f ns per call\n", alloc_ns / OPERATIONS );
+  printf( "   release_mem %8.1f ns per call\n", release_ns / OPERATIONS );
+  if( miss_fd >= 0 && read( miss_fd, &misses, sizeof( misses ) ) == sizeof( misses ) )
+    printf( "   alloc_mem   %8.1f cache misses per call\n",
+      (double) misses / OPERATIONS );
+  else
+    printf( "   alloc_mem   cache misses not available (perf_event_open)\n" );
+  printf( "   heap in use %8lu bytes for %lu requested (%.1f%% overhead)\n",
+    used_bytes, live_bytes, 100.0 * ( used_bytes - live_bytes ) / live_bytes );
+  return 0;
+}
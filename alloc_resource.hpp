@@ -0,0 +1,104 @@
+/* CPSC/ECE 3220 C++ adapters for the memory allocation program
+ *
+ * This header lets C++ containers allocate from the heap of alloc.c
+ * (compiled as C and linked in, with -DBENCH to leave out its test
+ * driver):
+ *
+ *   alloc_resource     a std::pmr::memory_resource that builds the
+ *                      region in its constructor and releases it in
+ *                      its destructor
+ *   heap_allocator<T>  a stateful allocator for the std:: containers
+ *                      that holds a pointer to an alloc_resource
+ *
+ *   alloc_resource heap( 64 * 1024 * 1024 );
+ *   std::pmr::vector<int> v( &heap );
+ *   std::vector<int, heap_allocator<int>> w( heap_allocator<int>( heap ) );
+ *
+ * alloc.c keeps its heap in globals, so only one alloc_resource can be
+ * alive at a time. Blocks from alloc_mem() are 16-byte aligned; larger
+ * alignments go to alloc_mem_aligned(). A request that cannot be met
+ * throws std::bad_alloc, as the standard allocators do.
+ */
+
+#ifndef ALLOC_RESOURCE_HPP
+#define ALLOC_RESOURCE_HPP
+
+#include <cstddef>
+#include <climits>
+#include <cstdint>
+#include <new>
+#include <memory_resource>
+
+extern "C" {
+  void init_region_mode( unsigned int size, int mode );
+  void release_region();
+  void *alloc_mem( unsigned int amount );
+  void *alloc_mem_aligned( unsigned int amount, unsigned int align );
+  unsigned int release_mem( void *ptr );
+  int free_size();
+}
+
+#define REGION_MALLOC 0
+#define REGION_HUGEPAGE 1
+#define REGION_RESERVE 2
+
+class alloc_resource : public std::pmr::memory_resource {
+public:
+  explicit alloc_resource( unsigned int size, int mode = REGION_MALLOC ){
+    init_region_mode( size, mode );
+  }
+  ~alloc_resource(){ release_region(); }
+
+  alloc_resource( const alloc_resource & ) = delete;
+  alloc_resource &operator=( const alloc_resource & ) = delete;
+
+private:
+  void *do_allocate( std::size_t bytes, std::size_t align ) override {
+    void *ptr;
+
+    if( bytes == 0 ) bytes = 1;
+    if( bytes > UINT_MAX || align > UINT_MAX ) throw std::bad_alloc();
+    if( align <= 16 ) ptr = alloc_mem( (unsigned int) bytes );
+    else ptr = alloc_mem_aligned( (unsigned int) bytes, (unsigned int) align );
+    if( ptr == nullptr ) throw std::bad_alloc();
+    return ptr;
+  }
+
+  void do_deallocate( void *ptr, std::size_t, std::size_t ) override {
+    release_mem( ptr );
+  }
+
+  bool do_is_equal( const std::pmr::memory_resource &other ) const noexcept override {
+    return this == &other;
+  }
+};
+
+template <class T>
+class heap_allocator {
+public:
+  typedef T value_type;
+
+  explicit heap_allocator( alloc_resource &heap ) noexcept : heap_( &heap ) {}
+  template <class U>
+  heap_allocator( const heap_allocator<U> &other ) noexcept : heap_( other.heap_ ) {}
+
+  T *allocate( std::size_t n ){
+    if( n > SIZE_MAX / sizeof( T ) ) throw std::bad_array_new_length();
+    return static_cast<T *>( heap_->allocate( n * sizeof( T ), alignof( T ) ) );
+  }
+
+  void deallocate( T *ptr, std::size_t n ) noexcept {
+    heap_->deallocate( ptr, n * sizeof( T ), alignof( T ) );
+  }
+
+  template <class U>
+  bool operator==( const heap_allocator<U> &other ) const noexcept { return heap_ == other.heap_; }
+  template <class U>
+  bool operator!=( const heap_allocator<U> &other ) const noexcept { return heap_ != other.heap_; }
+
+private:
+  template <class U> friend class heap_allocator;
+  alloc_resource *heap_;
+};
+
+#endif
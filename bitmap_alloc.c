@@ -0,0 +1,385 @@
+/* CPSC/ECE 3220 bitmap memory allocation program
+ *
+ * This program is an alternative backend for alloc.c with the same
+ * init_region_size(), alloc_mem() and release_mem() signatures. It
+ * keeps no tags or links in the region: free space is tracked by a
+ * bitmap with one bit per 16-byte granule, and the size of each
+ * allocation is kept in a side table, so the memory handed out has
+ * no headers at all.
+ *
+ *   region_base                                   region_base + size
+ *   |                                                             |
+ *   v                                                             v
+ *   +----+----+----+----+----+----+----+----+----+----+----+----+
+ *   |    granules of 16 bytes, allocated or free               |
+ *   +----+----+----+----+----+----+----+----+----+----+----+----+
+ *
+ *   free_map       bit g of word g/64 set => granule g is free
+ *   free_summary   bit w of word w/64 set => free_map[w] != 0
+ *   alloc_size[g]  number of granules in the allocation that starts
+ *                  at granule g, or 0 if no allocation starts there
+ *
+ * alloc_mem() searches next fit for a run of free granules: the search
+ * starts at the word where the previous allocation ended (next_word)
+ * and wraps around to the bottom of the region once. A run of n free
+ * granules inside a word is found with shift-and-mask steps rather
+ * than by testing one bit at a time, and runs may span words. Stretches
+ * of wholly allocated words are passed over 64 words at a time with
+ * free_summary, and words that can neither hold nor start a run are
+ * skipped four at a time with AVX2 (or two at a time with SSE2) when
+ * the processor supports it, and one at a time otherwise.
+ *
+ * release_mem() checks the side table to validate the pointer and
+ * then sets the bits of the allocation back to free. Coalescing is
+ * implicit: adjacent free granules are simply adjacent set bits.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <immintrin.h>
+
+#define GRANULE 16
+
+char *region_base;
+unsigned int region_granules;
+uint64_t *free_map;
+uint64_t *free_summary;
+unsigned int map_words;
+unsigned int next_word;
+unsigned int *alloc_size;
+
+
+/* skipping of words that cannot start a run
+ *
+ *   skip_words( w, n ) returns the index of the first word at or after
+ *   w that either holds a run of n free granules or has its top granule
+ *   free (so a run could start there and continue into the next word),
+ *   or map_words if there is none; it is only called when no run is
+ *   carried in from a previous word
+ *
+ *   the test for a run inside a word is the shift-and-mask step used by
+ *   run_in_word(); the AVX2 and SSE2 versions apply it to four or two
+ *   words at a time, and init_region_size() picks the widest version
+ *   the processor has
+ */
+
+#define TOP_BIT (1ULL << 63)
+
+unsigned int skip_words_scalar( unsigned int w, unsigned int n ){
+  unsigned int s, shift;
+  uint64_t x, t;
+
+  while( w < map_words ){
+    x = t = free_map[w];
+    if( x & TOP_BIT ) break;
+    for( s = 1; s < n && t != 0; s += shift ){
+      shift = ( s < n - s ) ? s : n - s;
+      t &= t >> shift;
+    }
+    if( t != 0 && n <= 64 ) break;
+    w++;
+  }
+  return w;
+}
+
+__attribute__ ((target ("sse2")))
+unsigned int skip_words_sse( unsigned int w, unsigned int n ){
+  unsigned int s, shift;
+  __m128i x, t, top = _mm_set1_epi64x( (long long) TOP_BIT );
+
+  while( n <= 64 && w + 2 <= map_words ){
+    x = t = _mm_loadu_si128( (__m128i *) (free_map + w) );
+    for( s = 1; s < n; s += shift ){
+      shift = ( s < n - s ) ? s : n - s;
+      t = _mm_and_si128( t, _mm_srl_epi64( t, _mm_cvtsi32_si128( shift ) ) );
+    }
+    t = _mm_or_si128( t, _mm_and_si128( x, top ) );
+    if( _mm_movemask_epi8( _mm_cmpeq_epi8( t, _mm_setzero_si128() ) ) != 0xffff ) break;
+    w += 2;
+  }
+  return skip_words_scalar( w, n );
+}
+
+__attribute__ ((target ("avx2")))
+unsigned int skip_words_avx2( unsigned int w, unsigned int n ){
+  unsigned int s, shift;
+  __m256i x, t, top = _mm256_set1_epi64x( (long long) TOP_BIT );
+
+  while( n <= 64 && w + 4 <= map_words ){
+    x = t = _mm256_loadu_si256( (__m256i *) (free_map + w) );
+    for( s = 1; s < n; s += shift ){
+      shift = ( s < n - s ) ? s : n - s;
+      t = _mm256_and_si256( t, _mm256_srl_epi64( t, _mm_cvtsi32_si128( shift ) ) );
+    }
+    t = _mm256_or_si256( t, _mm256_and_si256( x, top ) );
+    if( !_mm256_testz_si256( t, t ) ) break;
+    w += 4;
+  }
+  return skip_words_scalar( w, n );
+}
+
+unsigned int (*skip_words)( unsigned int, unsigned int ) = skip_words_scalar;
+
+
+/* set (value 1) or clear (value 0) the bits for granules [g, g+n) */
+
+void set_granules( unsigned int g, unsigned int n, int value ){
+  unsigned int w, bit, count;
+  uint64_t mask;
+
+  while( n > 0 ){
+    w = g / 64;
+    bit = g % 64;
+    count = ( 64 - bit < n ) ? 64 - bit : n;
+    mask = ( count == 64 ) ? ~0ULL : ( ( 1ULL << count ) - 1 ) << bit;
+    if( value ) free_map[w] |= mask;
+    else free_map[w] &= ~mask;
+    if( free_map[w] != 0 ) free_summary[w / 64] |= 1ULL << ( w % 64 );
+    else free_summary[w / 64] &= ~( 1ULL << ( w % 64 ) );
+    g += count;
+    n -= count;
+  }
+}
+
+/* return the bit position of the first run of n set bits that lies
+ * wholly within word x (1 <= n <= 64), or -1 if there is none */
+
+int run_in_word( uint64_t x, unsigned int n ){
+  unsigned int s = 1, shift;
+
+  // after each step bit i is set iff bits i .. i+s-1 were all set
+  while( s < n && x != 0 ){
+    shift = ( s < n - s ) ? s : n - s;
+    x &= x >> shift;
+    s += shift;
+  }
+  return ( x == 0 ) ? -1 : __builtin_ctzll( x );
+}
+
+/* return the index of the first word at or after w with a free granule,
+ * or map_words if there is none */
+
+unsigned int next_free_word( unsigned int w ){
+  unsigned int s = w / 64;
+  uint64_t bits;
+
+  if( w >= map_words ) return map_words;
+  bits = free_summary[s] & ( ~0ULL << ( w % 64 ) );
+  while( bits == 0 ){
+    if( ++s >= ( map_words + 63 ) / 64 ) return map_words;
+    bits = free_summary[s];
+  }
+  w = s * 64 + __builtin_ctzll( bits );
+  return ( w < map_words ) ? w : map_words;
+}
+
+
+void init_region_size( unsigned int size ){
+  region_granules = ( size + GRANULE - 1 ) / GRANULE;
+  map_words = ( region_granules + 63 ) / 64;
+
+  region_base = (char *) aligned_alloc( 64,
+    ( (size_t) region_granules * GRANULE + 63 ) / 64 * 64 );
+  free_map = (uint64_t *) calloc( map_words, sizeof( uint64_t ) );
+  free_summary = (uint64_t *) calloc( ( map_words + 63 ) / 64, sizeof( uint64_t ) );
+  alloc_size = (unsigned int *) calloc( region_granules, sizeof( unsigned int ) );
+  if( region_base == NULL || free_map == NULL || free_summary == NULL || alloc_size == NULL ){
+    printf( "no memory!\n" ); exit(0);
+  }
+  set_granules( 0, region_granules, 1 );
+  next_word = 0;
+
+  __builtin_cpu_init();
+  if( __builtin_cpu_supports( "avx2" ) ) skip_words = skip_words_avx2;
+  else if( __builtin_cpu_supports( "sse2" ) ) skip_words = skip_words_sse;
+  else skip_words = skip_words_scalar;
+
+  printf( "data structure starts at %p\n", region_base );
+  printf( "bitmap of %u granules is located at %p\n", region_granules, free_map );
+}
+
+void init_region(){
+  init_region_size( 1600 );
+}
+
+void prt_free_list(){
+  unsigned int g = 0, start;
+
+  printf( "   ---------------free runs---------------\n" );
+  while( g < region_granules ){
+    if( ( free_map[g / 64] >> ( g % 64 ) ) & 1 ){
+      start = g;
+      while( g < region_granules && ( ( free_map[g / 64] >> ( g % 64 ) ) & 1 ) ) g++;
+      printf( "   free run at %p of size 0x%x\n",
+        region_base + (size_t) start * GRANULE, ( g - start ) * GRANULE );
+    }else{
+      g++;
+    }
+  }
+  printf( "   --------------end of runs--------------\n" );
+}
+
+/* return the total size of the free granules */
+
+int free_size(){
+  unsigned int w;
+  int size = 0;
+
+  for( w = 0; w < map_words; w++ )
+    size += __builtin_popcountll( free_map[w] ) * GRANULE;
+  return size;
+}
+
+
+/* unsigned int find_run( unsigned int w, unsigned int n )
+ *
+ *   returns the first granule of the lowest run of n free granules
+ *   that starts in word w or above, or region_granules if there is none
+ */
+
+unsigned int find_run( unsigned int w, unsigned int n ){
+	unsigned int run = 0, start = 0, lead;
+	int pos;
+	uint64_t x;
+
+	while(w < map_words) {
+		if(run == 0) {
+			// Pass over allocated words, then skip ahead to a word
+			// where a run can start
+			w = skip_words(next_free_word(w), n);
+			if(w >= map_words) break;
+		}
+		x = free_map[w];
+		if(x == 0) {
+			run = 0;
+			w++;
+			continue;
+		}
+		if(x == ~0ULL) {
+			// Whole word is free, extend the current run
+			if(run == 0) start = w * 64;
+			run += 64;
+			if(run >= n) break;
+			w++;
+			continue;
+		}
+
+		// Run carried from previous words plus free bits at the bottom
+		if(run > 0 && run + __builtin_ctzll(~x) >= n) break;
+
+		// Run wholly inside this word
+		if(n <= 64) {
+			pos = run_in_word(x, n);
+			if(pos >= 0) {
+				start = w * 64 + pos;
+				run = n;
+				break;
+			}
+		}
+
+		// Free bits at the top start a run that may continue
+		lead = __builtin_clzll(~x);
+		run = lead;
+		start = w * 64 + 64 - lead;
+		w++;
+	}
+
+	if(w >= map_words || start + n > region_granules) return region_granules;
+	return start;
+}
+
+
+/* void *alloc_mem( unsigned int amount )
+ *
+ *   rounds "amount" up to whole granules and returns the lowest address
+ *   at or above next_word of a run of that many free granules, or the
+ *   lowest address in the region if there is none above, or NULL if
+ *   there is none at all (or for a request of zero bytes or one too
+ *   large to round up)
+ */
+
+void *alloc_mem( unsigned int amount ){
+	// Reject requests whose rounding to granules would wrap
+	if(amount == 0 || amount > 0xffffffff - (GRANULE - 1)) return NULL;
+
+	unsigned int n = (amount + GRANULE - 1) / GRANULE;
+	unsigned int start;
+
+	// Next fit, wrapping around to the bottom of the region once
+	start = find_run(next_word, n);
+	if(start == region_granules && next_word > 0) start = find_run(0, n);
+	if(start == region_granules) return NULL;
+
+	set_granules(start, n, 0);
+	alloc_size[start] = n;
+	next_word = (start + n) / 64;
+	return region_base + (size_t) start * GRANULE;
+}
+
+
+/* unsigned int release_mem( void *ptr )
+ *
+ *   returns the granules of an allocation to the bitmap; returns 0 for
+ *   a valid pointer and 1 for a pointer that is not the start of a
+ *   live allocation (including a repeated release)
+ */
+
+unsigned int release_mem( void *ptr ){
+	char *p = (char *) ptr;
+	unsigned int g;
+
+	if(p < region_base || p >= region_base + (size_t) region_granules * GRANULE) return 1;
+	if((p - region_base) % GRANULE != 0) return 1;
+
+	g = (p - region_base) / GRANULE;
+	if(alloc_size[g] == 0) return 1;
+
+	set_granules(g, alloc_size[g], 1);
+	alloc_size[g] = 0;
+	return 0;
+}
+
+
+#ifndef BENCH
+
+int main(){
+  void *ptr[8];
+  unsigned int rc;
+
+  init_region();
+  prt_free_list();
+
+  printf("alloc 0x640\n");
+  ptr[0] = alloc_mem(0x640); if(ptr[0]==NULL) printf("ptr[0] gets NULL\n");
+  prt_free_list();
+  printf("release 0x640\n");
+  rc=release_mem(ptr[0]); if(rc) printf("*** release_mem() fails\n");
+  prt_free_list();
+
+  printf("alloc 5 blocks and release 2\n");
+  ptr[1] = alloc_mem(0x100); if(ptr[1]==NULL) printf("ptr[1] gets NULL\n");
+  ptr[2] = alloc_mem(0x30);  if(ptr[2]==NULL) printf("ptr[2] gets NULL\n");
+  ptr[3] = alloc_mem(0x400); if(ptr[3]==NULL) printf("ptr[3] gets NULL\n");
+  ptr[4] = alloc_mem(0x50);  if(ptr[4]==NULL) printf("ptr[4] gets NULL\n");
+  ptr[5] = alloc_mem(0x60);  if(ptr[5]==NULL) printf("ptr[5] gets NULL\n");
+  rc=release_mem(ptr[1]); if(rc) printf("*** release_mem() fails\n");
+  rc=release_mem(ptr[4]); if(rc) printf("*** release_mem() fails\n");
+  prt_free_list();
+
+  printf("alloc 0x40, then 0x200 which does not fit\n");
+  ptr[6] = alloc_mem(0x40);  if(ptr[6]==NULL) printf("ptr[6] gets NULL\n");
+  ptr[7] = alloc_mem(0x200);
+  if(ptr[7]==NULL) printf("*** alloc_mem() returns NULL\n");
+  prt_free_list();
+
+  printf("re-release ptr[4] - logical error\n"); rc=release_mem(ptr[4]);
+  if(rc) printf("*** release_mem() fails\n");
+  printf("release interior pointer - logical error\n");
+  rc=release_mem((char *)ptr[3] + 16);
+  if(rc) printf("*** release_mem() fails\n");
+  return 0;
+}
+
+#endif
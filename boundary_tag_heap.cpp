@@ -0,0 +1,117 @@
+/* CPSC/ECE 3220 boundary tag heap template driver
+ *
+ * This program runs the test sequence of alloc.c on an instance of
+ * BoundaryTagHeap with the geometry of init_region(), so its output
+ * matches that of alloc.out up to addresses, and then prints the
+ * derived constants of a few other instances.
+ */
+
+#include <cstdio>
+#include "boundary_tag_heap.hpp"
+
+template <class Heap>
+void prt_geometry( const char *name ){
+  printf( "%s: tag %zu, granule shift %u, free block %zu, end tag at %zu, top_region at %zu, header at %zu\n",
+    name, Heap::tag_bytes, Heap::granule_shift, Heap::free_bytes,
+    Heap::end_memblk_offset, Heap::top_region_offset, Heap::header_offset );
+}
+
+int main(){
+  static BoundaryTagHeap<1680> heap;
+  void *ptr[20];
+  unsigned int rc;
+
+  printf("start memory allocation test, pointer size is %lu bytes\n",
+    sizeof(void *));
+  printf( "data structure starts at %p\n", (void *) heap.base() );
+  printf( "free_list is located at %p\n", (void *) heap.free_list() );
+  heap.print_free_list();
+
+  printf("alloc 0x640\n");
+  ptr[0] = heap.allocate(0x640); if(ptr[0]==NULL) printf("ptr[0] gets NULL\n");
+  heap.print_free_list();
+  printf("release 0x640\n");
+  rc=heap.release(ptr[0]); if(rc) printf("*** release_mem() fails\n");
+  heap.print_free_list();
+
+  printf("alloc 6 blocks\n");
+  ptr[1] = heap.allocate(0x100); if(ptr[1]==NULL) printf("ptr[1] gets NULL\n");
+  ptr[2] = heap.allocate(0x100); if(ptr[2]==NULL) printf("ptr[2] gets NULL\n");
+  ptr[3] = heap.allocate(0x100); if(ptr[3]==NULL) printf("ptr[3] gets NULL\n");
+  ptr[4] = heap.allocate(0x100); if(ptr[4]==NULL) printf("ptr[4] gets NULL\n");
+  ptr[5] = heap.allocate(0x100); if(ptr[5]==NULL) printf("ptr[5] gets NULL\n");
+  ptr[6] = heap.allocate(0xa0);  if(ptr[6]==NULL) printf("ptr[6] gets NULL\n");
+  heap.print_free_list();
+
+  printf("try to alloc 0xa0 more\n");
+  ptr[7] = heap.allocate(0xa0);
+  if(ptr[7]==NULL) printf("*** alloc_mem() returns NULL\n");
+  heap.print_free_list();
+  printf("release ptr[1] - tests case 1\n"); rc=heap.release(ptr[1]);
+  if(rc) printf("*** release_mem() fails\n");
+  heap.print_free_list();
+  printf("release ptr[4] - tests case 1\n"); rc=heap.release(ptr[4]);
+  if(rc) printf("*** release_mem() fails\n");
+  heap.print_free_list();
+  printf("release ptr[3] - tests case 2\n"); rc=heap.release(ptr[3]);
+  if(rc) printf("*** release_mem() fails\n");
+  heap.print_free_list();
+  printf("release ptr[5] - tests case 3\n"); rc=heap.release(ptr[5]);
+  if(rc) printf("*** release_mem() fails\n");
+  heap.print_free_list();
+  printf("release ptr[2] - tests case 4\n"); rc=heap.release(ptr[2]);
+  if(rc) printf("*** release_mem() fails\n");
+  heap.print_free_list();
+  printf("release ptr[6] - tests case 3\n"); rc=heap.release(ptr[6]);
+  if(rc) printf("*** release_mem() fails\n");
+  heap.print_free_list();
+  printf("re-release ptr[2] - logical error\n"); rc=heap.release(ptr[2]);
+  if(rc) printf("*** release_mem() fails\n");
+
+  printf("alloc 12 blocks and release 5 to create 6 free blocks\n");
+  ptr[1] = heap.allocate(0x60); if(ptr[1]==NULL) printf("ptr[1] gets NULL\n");
+  ptr[2] = heap.allocate(0x50); if(ptr[2]==NULL) printf("ptr[2] gets NULL\n");
+  ptr[3] = heap.allocate(0x50); if(ptr[3]==NULL) printf("ptr[3] gets NULL\n");
+  ptr[4] = heap.allocate(0x40); if(ptr[4]==NULL) printf("ptr[4] gets NULL\n");
+  ptr[5] = heap.allocate(0x40); if(ptr[5]==NULL) printf("ptr[5] gets NULL\n");
+  ptr[6] = heap.allocate(0x30); if(ptr[6]==NULL) printf("ptr[6] gets NULL\n");
+  ptr[7] = heap.allocate(0x30); if(ptr[7]==NULL) printf("ptr[7] gets NULL\n");
+  ptr[8] = heap.allocate(0x20); if(ptr[8]==NULL) printf("ptr[8] gets NULL\n");
+  ptr[9] = heap.allocate(0x20); if(ptr[9]==NULL) printf("ptr[9] gets NULL\n");
+  ptr[10] = heap.allocate(0x10); if(ptr[10]==NULL) printf("ptr[10] gets NULL\n");
+  ptr[11] = heap.allocate(0x10); if(ptr[11]==NULL) printf("ptr[11] gets NULL\n");
+  ptr[12] = heap.allocate(0x293); if(ptr[12]==NULL) printf("ptr[12] gets NULL\n");
+  rc=heap.release(ptr[2]); if(rc) printf("*** release_mem() fails\n");
+  rc=heap.release(ptr[4]); if(rc) printf("*** release_mem() fails\n");
+  rc=heap.release(ptr[6]); if(rc) printf("*** release_mem() fails\n");
+  rc=heap.release(ptr[8]); if(rc) printf("*** release_mem() fails\n");
+  rc=heap.release(ptr[10]); if(rc) printf("*** release_mem() fails\n");
+  heap.print_free_list();
+  ptr[13] = heap.allocate(0x20); if(ptr[13]==NULL) printf("ptr[13] gets NULL\n");
+  heap.print_free_list();
+  ptr[14] = heap.allocate(0x20); if(ptr[14]==NULL) printf("ptr[14] gets NULL\n");
+  heap.print_free_list();
+  ptr[15] = heap.allocate(0x20); if(ptr[15]==NULL) printf("ptr[15] gets NULL\n");
+  heap.print_free_list();
+  ptr[16] = heap.allocate(0x20); if(ptr[16]==NULL) printf("ptr[16] gets NULL\n");
+  heap.print_free_list();
+  ptr[17] = heap.allocate(0x20);
+  if(ptr[17]==NULL) printf("*** alloc_mem() returns NULL\n");
+  heap.print_free_list();
+
+
+  printf("geometry of other instances\n");
+  prt_geometry<BoundaryTagHeap<1680>>( "BoundaryTagHeap<1680>" );
+  prt_geometry<BoundaryTagHeap<65536, 64, 192>>( "BoundaryTagHeap<65536, 64, 192>" );
+  prt_geometry<BoundaryTagHeap<1 << 20, 16, 48, best_fit>>( "BoundaryTagHeap<1 << 20, 16, 48, best_fit>" );
+  {
+    static BoundaryTagHeap<65536, 64, 192, best_fit> lines;
+    void *a = lines.allocate( 100 ), *b = lines.allocate( 1 );
+    printf( "64-byte granules: 100 bytes at offset %ld, 1 byte at offset %ld, %zu bytes free\n",
+      (long) ( (char *) a - lines.base() ), (long) ( (char *) b - lines.base() ), lines.free_size() );
+    rc = lines.release( a ) | lines.release( b );
+    if( rc ) printf( "*** release() fails\n" );
+    printf( "%zu bytes free after release\n", lines.free_size() );
+  }
+  return 0;
+}
@@ -0,0 +1,253 @@
+/* CPSC/ECE 3220 boundary tag heap template
+ *
+ * BoundaryTagHeap<RegionBytes, Granule, MinSplit, Policy> is the heap
+ * of alloc.c with its geometry fixed at compile time. The layout of the
+ * region, the tag blocks and their signatures, the free list and the
+ * four coalescing cases of release_mem() are the same; only the numbers
+ * that alloc.c writes as literals are derived from the parameters:
+ *
+ *   RegionBytes  total bytes of the region, including the four tag
+ *                blocks and the free list header node (1680 for the
+ *                region of init_region())
+ *   Granule      allocation unit and tag block size, a power of two
+ *                of at least 16 (16 in alloc.c); tag blocks are padded
+ *                to Granule bytes so that every payload stays aligned
+ *   MinSplit     least number of bytes that must be left in a free
+ *                block for it to be split (48 in alloc.c)
+ *   Policy       fit policy type with a static search() over the free
+ *                list, first_fit (as in alloc.c) or best_fit
+ *
+ * The derived constants are static constexpr members, so rounding and
+ * tag stepping compile to masks and shifts, and a bad combination of
+ * parameters is a compile-time error. For the defaults and 1680 bytes:
+ *
+ *   free_bytes         1600   size of the initial free block
+ *   end_memblk_offset  1632   its ending tag block
+ *   top_region_offset  1648   the "top_region" tag block
+ *   header_offset      1664   the free list header node
+ *
+ * Each heap owns its region as an array member, so there may be any
+ * number of heaps, and a heap is neither copied nor moved (the free
+ * list points into the object).
+ */
+
+#ifndef BOUNDARY_TAG_HEAP_HPP
+#define BOUNDARY_TAG_HEAP_HPP
+
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+
+/* fit policies: return the free block node to allocate "size" bytes
+ * from, or nullptr */
+
+struct first_fit {
+  template <class Heap>
+  static typename Heap::free_block *search( typename Heap::free_block *hdr, unsigned int size ){
+    for( typename Heap::free_block *ptr = hdr->fwd_link; ptr != hdr; ptr = ptr->fwd_link )
+      if( Heap::tag_of( ptr )->size >= size ) return ptr;
+    return nullptr;
+  }
+};
+
+struct best_fit {
+  template <class Heap>
+  static typename Heap::free_block *search( typename Heap::free_block *hdr, unsigned int size ){
+    typename Heap::free_block *best = nullptr;
+    unsigned int best_size = 0, s;
+
+    for( typename Heap::free_block *ptr = hdr->fwd_link; ptr != hdr; ptr = ptr->fwd_link ){
+      s = Heap::tag_of( ptr )->size;
+      if( s < size || ( best != nullptr && s >= best_size ) ) continue;
+      best = ptr;
+      best_size = s;
+      if( s == size ) break;
+    }
+    return best;
+  }
+};
+
+template <std::size_t RegionBytes, std::size_t Granule = 16,
+          std::size_t MinSplit = 48, class Policy = first_fit>
+class BoundaryTagHeap {
+public:
+  struct alignas( Granule ) tag_block { char tag; char sig[11]; unsigned int size; };
+  struct free_block { free_block *back_link, *fwd_link; };
+
+  static constexpr std::size_t round_up( std::size_t n ){ return ( n + Granule - 1 ) & ~( Granule - 1 ); }
+  static constexpr std::size_t round_down( std::size_t n ){ return n & ~( Granule - 1 ); }
+  static constexpr unsigned int log2( std::size_t n ){ return ( n <= 1 ) ? 0 : 1 + log2( n >> 1 ); }
+
+  static constexpr std::size_t tag_bytes = sizeof( tag_block );
+  static constexpr unsigned int granule_shift = log2( Granule );
+  static constexpr std::size_t overhead = 2 * tag_bytes;
+  static constexpr std::size_t header_bytes = round_up( sizeof( free_block ) );
+  static constexpr std::size_t free_bytes = round_down( RegionBytes - 4 * tag_bytes - header_bytes );
+  static constexpr std::size_t top_memblk_offset = tag_bytes;
+  static constexpr std::size_t first_block_offset = 2 * tag_bytes;
+  static constexpr std::size_t end_memblk_offset = free_bytes + 2 * tag_bytes;
+  static constexpr std::size_t top_region_offset = free_bytes + 3 * tag_bytes;
+  static constexpr std::size_t header_offset = free_bytes + 4 * tag_bytes;
+
+  static_assert( Granule >= 16 && ( Granule & ( Granule - 1 ) ) == 0,
+    "Granule must be a power of two of at least 16" );
+  static_assert( tag_bytes == Granule, "a tag block must fill one granule" );
+  static_assert( MinSplit % Granule == 0 && MinSplit >= overhead + Granule,
+    "MinSplit must hold two tag blocks and a granule" );
+  static_assert( RegionBytes >= 4 * tag_bytes + header_bytes + Granule,
+    "region too small for one free granule" );
+  static_assert( free_bytes <= 0xffffffffu, "block sizes must fit the 4-byte size field" );
+
+  BoundaryTagHeap(){
+    tag_block *ptr;
+    free_block *links1, *links2;
+
+    ptr = tag_at( 0 );
+    ptr->tag = 1; std::strcpy( ptr->sig, "end_region" ); ptr->size = 0;
+    ptr = tag_at( top_memblk_offset );
+    ptr->tag = 0; std::strcpy( ptr->sig, "top_memblk" ); ptr->size = free_bytes;
+    ptr = tag_at( end_memblk_offset );
+    ptr->tag = 0; std::strcpy( ptr->sig, "end_memblk" ); ptr->size = free_bytes;
+    ptr = tag_at( top_region_offset );
+    ptr->tag = 1; std::strcpy( ptr->sig, "top_region" ); ptr->size = 0;
+
+    links1 = reinterpret_cast<free_block *>( region_ + first_block_offset );
+    links2 = reinterpret_cast<free_block *>( region_ + header_offset );
+    links1->back_link = links1->fwd_link = links2;
+    links2->back_link = links2->fwd_link = links1;
+    free_list_ = links2;
+  }
+
+  BoundaryTagHeap( const BoundaryTagHeap & ) = delete;
+  BoundaryTagHeap &operator=( const BoundaryTagHeap & ) = delete;
+
+  static tag_block *tag_of( void *ptr ){ return static_cast<tag_block *>( ptr ) - 1; }
+
+  char *base(){ return reinterpret_cast<char *>( region_ ); }
+  free_block *free_list(){ return free_list_; }
+
+  /* alloc_mem(): first fit (or the Policy's fit) from the bottom of a
+   * free block, which is split when at least MinSplit bytes remain */
+
+  void *allocate( std::size_t amount ){
+    if( amount == 0 || amount > free_bytes ) return nullptr;
+
+    unsigned int req = round_up( amount );
+    free_block *ptr = Policy::template search<BoundaryTagHeap>( free_list_, req );
+    if( ptr == nullptr ) return nullptr;
+
+    tag_block *top = tag_of( ptr ), *end = top + ( top->size >> granule_shift ) + 1;
+    tag_block *new_end, *alloc_top;
+
+    if( top->size >= req + MinSplit ){
+      // shrink the free block and put the allocation below it
+      top->size -= req + overhead;
+      new_end = top + ( top->size >> granule_shift ) + 1;
+      new_end->tag = 0; std::strcpy( new_end->sig, "end_memblk" ); new_end->size = top->size;
+
+      alloc_top = end - ( req >> granule_shift ) - 1;
+      alloc_top->tag = 1; std::strcpy( alloc_top->sig, "top_alcblk" ); alloc_top->size = req;
+      end->tag = 1; std::strcpy( end->sig, "end_alcblk" ); end->size = req;
+      return alloc_top + 1;
+    }
+
+    // the whole block is allocated and leaves the free list
+    ptr->back_link->fwd_link = ptr->fwd_link;
+    ptr->fwd_link->back_link = ptr->back_link;
+    top->tag = 1; std::strcpy( top->sig, "top_alcblk" );
+    end->tag = 1; std::strcpy( end->sig, "end_alcblk" ); end->size = top->size;
+    return ptr;
+  }
+
+  /* release_mem(): 0 for a valid pointer, 1 otherwise; coalesces with
+   * the free blocks above and below as in the four cases of alloc.c */
+
+  unsigned int release( void *ptr ){
+    char *p = static_cast<char *>( ptr );
+
+    if( p < base() + first_block_offset || p >= base() + end_memblk_offset ) return 1;
+    if( ( p - base() ) % Granule != 0 ) return 1;
+
+    free_block *fb = static_cast<free_block *>( ptr );
+    tag_block *top = tag_of( ptr );
+    if( std::strncmp( top->sig, "top_alcblk", 10 ) != 0 || top->tag != 1 ) return 1;
+    tag_block *end = top + ( top->size >> granule_shift ) + 1;
+    if( end->tag != 1 || end->size != top->size ) return 1;
+
+    tag_block *upper_end = top - 1, *lower_top = end + 1, *upper_top = nullptr, *lower_end = nullptr;
+    bool upper_free = ( upper_end->tag == 0 ), lower_free = ( lower_top->tag == 0 );
+    free_block *lower = reinterpret_cast<free_block *>( lower_top + 1 );
+
+    if( upper_free ) upper_top = upper_end - ( upper_end->size >> granule_shift ) - 1;
+    if( lower_free ) lower_end = lower_top + ( lower_top->size >> granule_shift ) + 1;
+
+    if( !upper_free && !lower_free ){
+      // case 1: a new node at the head of the list
+      top->tag = 0; end->tag = 0;
+      fb->back_link = free_list_;
+      fb->fwd_link = free_list_->fwd_link;
+      free_list_->fwd_link->back_link = fb;
+      free_list_->fwd_link = fb;
+      std::strcpy( top->sig, "top_memblk" );
+      std::strcpy( end->sig, "end_memblk" );
+    }else if( upper_free && !lower_free ){
+      // case 2: the block above grows down over this one
+      upper_top->size += top->size + overhead;
+      end->tag = 0; end->size = upper_top->size;
+      std::strcpy( end->sig, "end_memblk" );
+      std::strcpy( upper_end->sig, "old_end_mb" );
+      std::strcpy( top->sig, "old_top_mb" );
+    }else if( !upper_free && lower_free ){
+      // case 3: this block takes over the node of the block below
+      top->tag = 0;
+      top->size += lower_end->size + overhead;
+      lower_end->size = top->size;
+      fb->fwd_link = lower->fwd_link; fb->fwd_link->back_link = fb;
+      fb->back_link = lower->back_link; fb->back_link->fwd_link = fb;
+      std::strcpy( top->sig, "top_memblk" );
+      std::strcpy( end->sig, "old_end_mb" );
+      std::strcpy( lower_top->sig, "old_top_mb" );
+    }else{
+      // case 4: the block above absorbs this one and the block below
+      upper_top->size += top->size + lower_end->size + 2 * overhead;
+      lower_end->size = upper_top->size;
+      lower->back_link->fwd_link = lower->fwd_link;
+      lower->fwd_link->back_link = lower->back_link;
+      std::strcpy( upper_end->sig, "old_end_mb" );
+      std::strcpy( top->sig, "old_top_mb" );
+      std::strcpy( end->sig, "old_end_mb" );
+      std::strcpy( lower_top->sig, "old_top_mb" );
+    }
+    return 0;
+  }
+
+  /* free_size(): total bytes of the free blocks */
+
+  std::size_t free_size(){
+    std::size_t size = 0;
+    for( free_block *ptr = free_list_->fwd_link; ptr != free_list_; ptr = ptr->fwd_link )
+      size += tag_of( ptr )->size;
+    return size;
+  }
+
+  /* prt_free_list() */
+
+  void print_free_list(){
+    if( free_list_->fwd_link == free_list_ ){
+      std::printf( "   ----------free list is empty-----------\n" );
+      return;
+    }
+    std::printf( "   ---------------free list---------------\n" );
+    for( free_block *ptr = free_list_->fwd_link; ptr != free_list_; ptr = ptr->fwd_link )
+      std::printf( "   free block at %p of size 0x%x\n", (void *) ptr, tag_of( ptr )->size );
+    std::printf( "   --------------end of list--------------\n" );
+  }
+
+private:
+  tag_block *tag_at( std::size_t offset ){ return reinterpret_cast<tag_block *>( region_ + offset ); }
+
+  alignas( Granule ) unsigned char region_[RegionBytes];
+  free_block *free_list_;
+};
+
+#endif
@@ -0,0 +1,318 @@
+/* CPSC/ECE 3220 buddy system memory allocation program
+ *
+ * This program is an alternative engine for alloc.c. The engine itself
+ * is buddy_init(), buddy_alloc(), buddy_release(), buddy_free_size()
+ * and buddy_prt_free_list(); compiled with -DBUDDY_ENGINE and linked
+ * with alloc.c, it serves alloc_mem() and release_mem() for a region
+ * built with init_region_mode( size, REGION_BUDDY ). Compiled by itself
+ * it is a test program with the usual init_region_size(), alloc_mem()
+ * and release_mem() on a region obtained with malloc(). The region is
+ * managed as a binary buddy system over 16-byte granules:
+ *
+ *   - a block of order k is 2^k granules long and starts at a granule
+ *     offset that is a multiple of 2^k
+ *   - the buddy of the block at offset "off" is at offset off ^ 2^k
+ *   - requests are rounded up to the next power of two granules; a
+ *     larger free block is split in halves until the order fits, and
+ *     the upper halves go onto the free lists
+ *   - on release, a block is merged with its buddy for as long as the
+ *     buddy is free and of the same order
+ *
+ * If the region is not a power of two granules long, it is managed as
+ * a run of root blocks of decreasing order; a buddy that would extend
+ * past the end of the region is never free, so roots are not merged.
+ *
+ * There are no headers or footers in the blocks. Each order has a
+ * circular, doubly-linked free list with a header node, threaded
+ * through the free blocks as in alloc.c, and two side bitmaps:
+ *
+ *   free_bits[k]   bit i set => block i of order k is on free list k
+ *   split_bits[k]  bit i set => block i of order k has been split into
+ *                  two blocks of order k-1 (k = 1 .. max_order+1)
+ *
+ * The order of an allocated block is the smallest k for which the
+ * enclosing block of order k+1 is split, so release_mem() needs only
+ * the pointer. The split bits of the parents of the root blocks are
+ * set at initialization so that this holds for roots too. The two
+ * bitmaps cost about three bits per granule.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#define GRANULE 16
+#define MAX_ORDERS 32
+
+struct free_block { struct free_block *back_link, *fwd_link; };
+
+char *buddy_base;
+unsigned int buddy_granules;
+unsigned int max_order;
+struct free_block free_lists[MAX_ORDERS];
+uint64_t *free_bits[MAX_ORDERS];
+uint64_t *split_bits[MAX_ORDERS + 1];
+
+#define BIT_TEST(map,i) (((map)[(i)/64] >> ((i)%64)) & 1)
+#define BIT_SET(map,i) ((map)[(i)/64] |= 1ULL << ((i)%64))
+#define BIT_CLEAR(map,i) ((map)[(i)/64] &= ~(1ULL << ((i)%64)))
+
+#define BLOCK_ADDR(off) ((struct free_block *)(buddy_base + (size_t)(off) * GRANULE))
+#define BLOCK_OFF(p) ((unsigned int)(((char *)(p) - buddy_base) / GRANULE))
+
+
+/* free list helpers; free_bits[k] tracks membership of list k */
+
+void push_free( unsigned int off, unsigned int k ){
+  struct free_block *fb = BLOCK_ADDR( off );
+  struct free_block *hdr = &free_lists[k];
+
+  fb->back_link = hdr;
+  fb->fwd_link = hdr->fwd_link;
+  hdr->fwd_link->back_link = fb;
+  hdr->fwd_link = fb;
+  BIT_SET( free_bits[k], off >> k );
+}
+
+void unlink_free( unsigned int off, unsigned int k ){
+  struct free_block *fb = BLOCK_ADDR( off );
+
+  fb->back_link->fwd_link = fb->fwd_link;
+  fb->fwd_link->back_link = fb->back_link;
+  BIT_CLEAR( free_bits[k], off >> k );
+}
+
+
+/* void buddy_init( char *base, unsigned int size )
+ *
+ *   sets up the buddy system over the "size" bytes at "base" (which must
+ *   be 16-byte aligned), rounded down to whole granules
+ */
+
+void buddy_init( char *base, unsigned int size ){
+  unsigned int k, words, off;
+  uint64_t *bits;
+
+  buddy_base = base;
+  buddy_granules = size / GRANULE;
+  if( buddy_granules == 0 ){ printf( "region too small!\n" ); exit(0); }
+
+  max_order = 63 - __builtin_clzll( buddy_granules );
+
+  // One allocation holds the bitmaps of all orders (and replaces
+  // that of an earlier region)
+  free( free_bits[0] );
+  words = 0;
+  for( k = 0; k <= max_order + 1; k++ )
+    words += 2 * ( ( buddy_granules >> k ) / 64 + 1 );
+  bits = (uint64_t *) calloc( words, sizeof( uint64_t ) );
+  if( bits == NULL ){ printf( "no memory!\n" ); exit(0); }
+  for( k = 0; k <= max_order + 1; k++ ){
+    if( k <= max_order ){
+      free_bits[k] = bits;
+      bits += ( buddy_granules >> k ) / 64 + 1;
+    }
+    split_bits[k] = bits;
+    bits += ( buddy_granules >> k ) / 64 + 1;
+  }
+
+  for( k = 0; k <= max_order; k++ ){
+    free_lists[k].back_link = &free_lists[k];
+    free_lists[k].fwd_link = &free_lists[k];
+  }
+
+  // Cover the region with root blocks of decreasing order
+  off = 0;
+  for( k = max_order + 1; k-- > 0; ){
+    if( ( buddy_granules - off ) >> k ){
+      push_free( off, k );
+      BIT_SET( split_bits[k + 1], off >> ( k + 1 ) );
+      off += 1U << k;
+    }
+  }
+}
+
+void buddy_prt_free_list(){
+  struct free_block *ptr;
+  unsigned int k;
+
+  printf( "   ---------------free lists--------------\n" );
+  for( k = 0; k <= max_order; k++ ){
+    for( ptr = free_lists[k].fwd_link; ptr != &free_lists[k]; ptr = ptr->fwd_link )
+      printf( "   free block at %p of size 0x%x (order %u)\n",
+        (char *) ptr, ( 1U << k ) * GRANULE, k );
+  }
+  printf( "   --------------end of lists-------------\n" );
+}
+
+/* return the total size of the free blocks */
+
+int buddy_free_size(){
+  struct free_block *ptr;
+  unsigned int k;
+  int size = 0;
+
+  for( k = 0; k <= max_order; k++ )
+    for( ptr = free_lists[k].fwd_link; ptr != &free_lists[k]; ptr = ptr->fwd_link )
+      size += ( 1U << k ) * GRANULE;
+  return size;
+}
+
+
+/* void *buddy_alloc( unsigned int amount )
+ *
+ *   rounds "amount" up to a power of two granules, takes a block from
+ *   the smallest non-empty free list of at least that order, and splits
+ *   it down to the requested order; returns NULL if no block is large
+ *   enough (or for a request of zero bytes)
+ */
+
+void *buddy_alloc( unsigned int amount ){
+	if(amount == 0) return NULL;
+
+	unsigned int n = (amount + GRANULE - 1) / GRANULE;
+	unsigned int k = (n == 1) ? 0 : 64 - __builtin_clzll(n - 1);
+	unsigned int j, off;
+
+	// Find the smallest order with a free block
+	for(j = k; j <= max_order; j++)
+		if(free_lists[j].fwd_link != &free_lists[j]) break;
+	if(j > max_order) return NULL;
+
+	off = BLOCK_OFF(free_lists[j].fwd_link);
+	unlink_free(off, j);
+
+	// Split, keeping the lower half and freeing the upper half
+	while(j > k) {
+		BIT_SET(split_bits[j], off >> j);
+		j--;
+		push_free(off + (1U << j), j);
+	}
+
+	return BLOCK_ADDR(off);
+}
+
+
+/* unsigned int buddy_release( void *ptr )
+ *
+ *   finds the order of the block from the split bits and merges it
+ *   with its buddy for as long as the buddy is free; returns 0 for a
+ *   valid pointer and 1 for a pointer that is not the start of an
+ *   allocated block (including a repeated release)
+ */
+
+unsigned int buddy_release( void *ptr ){
+	char *p = (char *) ptr;
+	unsigned int off, buddy, k;
+
+	if(p < buddy_base || p >= buddy_base + (size_t) buddy_granules * GRANULE) return 1;
+	if((p - buddy_base) % GRANULE != 0) return 1;
+	off = BLOCK_OFF(p);
+
+	// The block order is the first order whose parent is split
+	k = 0;
+	while(k <= max_order && !BIT_TEST(split_bits[k + 1], off >> (k + 1))) k++;
+	if(k > max_order) return 1;
+	if((off & ((1U << k) - 1)) != 0) return 1;
+	if(BIT_TEST(free_bits[k], off >> k)) return 1;
+
+	// Merge with the buddy while it is free at the same order
+	while(k < max_order) {
+		buddy = off ^ (1U << k);
+		if(buddy + (1U << k) > buddy_granules) break;
+		if(!BIT_TEST(free_bits[k], buddy >> k)) break;
+		unlink_free(buddy, k);
+		if(buddy < off) off = buddy;
+		k++;
+		BIT_CLEAR(split_bits[k], off >> k);
+	}
+
+	push_free(off, k);
+	return 0;
+}
+
+
+#ifndef BUDDY_ENGINE
+
+/* the test program's interface, as in alloc.c */
+
+char *region_base;
+
+void init_region_size( unsigned int size ){
+  region_base = (char *) malloc( size / GRANULE * GRANULE );
+  if( region_base == NULL ){ printf( "no memory!\n" ); exit(0); }
+  buddy_init( region_base, size );
+
+  printf( "data structure starts at %p\n", region_base );
+  printf( "buddy system of %u granules, max order %u\n",
+    buddy_granules, max_order );
+}
+
+void init_region(){
+  init_region_size( 1600 );
+}
+
+void prt_free_list(){
+  buddy_prt_free_list();
+}
+
+int free_size(){
+  return buddy_free_size();
+}
+
+void *alloc_mem( unsigned int amount ){
+  return buddy_alloc( amount );
+}
+
+unsigned int release_mem( void *ptr ){
+  return buddy_release( ptr );
+}
+
+#endif
+
+
+#if !defined(BUDDY_ENGINE) && !defined(BENCH)
+
+int main(){
+  void *ptr[8];
+  unsigned int rc;
+
+  init_region();
+  prt_free_list();
+
+  printf("alloc 0x400\n");
+  ptr[0] = alloc_mem(0x400); if(ptr[0]==NULL) printf("ptr[0] gets NULL\n");
+  prt_free_list();
+  printf("release 0x400\n");
+  rc=release_mem(ptr[0]); if(rc) printf("*** release_mem() fails\n");
+  prt_free_list();
+
+  printf("alloc 0x10, 0x100, 0x30 and 0x80\n");
+  ptr[1] = alloc_mem(0x10);  if(ptr[1]==NULL) printf("ptr[1] gets NULL\n");
+  ptr[2] = alloc_mem(0x100); if(ptr[2]==NULL) printf("ptr[2] gets NULL\n");
+  ptr[3] = alloc_mem(0x30);  if(ptr[3]==NULL) printf("ptr[3] gets NULL\n");
+  ptr[4] = alloc_mem(0x80);  if(ptr[4]==NULL) printf("ptr[4] gets NULL\n");
+  prt_free_list();
+
+  printf("try to alloc 0x800\n");
+  ptr[5] = alloc_mem(0x800);
+  if(ptr[5]==NULL) printf("*** alloc_mem() returns NULL\n");
+
+  printf("release all four, merging back to the roots\n");
+  rc=release_mem(ptr[3]); if(rc) printf("*** release_mem() fails\n");
+  rc=release_mem(ptr[1]); if(rc) printf("*** release_mem() fails\n");
+  rc=release_mem(ptr[4]); if(rc) printf("*** release_mem() fails\n");
+  rc=release_mem(ptr[2]); if(rc) printf("*** release_mem() fails\n");
+  prt_free_list();
+
+  printf("re-release ptr[2] - logical error\n"); rc=release_mem(ptr[2]);
+  if(rc) printf("*** release_mem() fails\n");
+  printf("release interior pointer - logical error\n");
+  ptr[6] = alloc_mem(0x100);
+  rc=release_mem((char *)ptr[6] + 16);
+  if(rc) printf("*** release_mem() fails\n");
+  return 0;
+}
+
+#endif
@@ -0,0 +1,112 @@
+/* CPSC/ECE 3220 container benchmark
+ *
+ * This driver times container-heavy workloads with the default
+ * allocator and with the heap of alloc.c through the adapters of
+ * alloc_resource.hpp (heap_allocator<T> and std::pmr):
+ *
+ *   map churn       std::map<int,int> held at MAP_LIVE entries while
+ *                   MAP_OPS random keys are inserted or erased
+ *   unordered churn the same workload on std::unordered_map
+ *   vector growth   VECTORS vectors grown together by push_back() to
+ *                   VECTOR_LENGTH elements each, then destroyed
+ *
+ * The random keys come from a fixed-seed generator, so every allocator
+ * sees the same sequence of requests.
+ */
+
+#include <cstdio>
+#include <chrono>
+#include <map>
+#include <unordered_map>
+#include <vector>
+#include <functional>
+#include "alloc_resource.hpp"
+
+#define REGION_SIZE (256 * 1024 * 1024)
+#define MAP_LIVE 50000
+#define MAP_OPS 500000
+#define VECTORS 1000
+#define VECTOR_LENGTH 2000
+#define VECTOR_ROUNDS 5
+
+unsigned int bench_seed;
+
+unsigned int bench_random(){
+  bench_seed = bench_seed * 1103515245 + 12345;
+  return ( bench_seed >> 8 );
+}
+
+double time_ms( const std::function<void()> &work ){
+  auto t0 = std::chrono::steady_clock::now();
+  work();
+  auto t1 = std::chrono::steady_clock::now();
+  return std::chrono::duration<double, std::milli>( t1 - t0 ).count();
+}
+
+template <class Map>
+void map_churn( Map &m ){
+  unsigned int i;
+  int key;
+
+  bench_seed = 12345;
+  for( i = 0; i < MAP_OPS; i++ ){
+    key = bench_random() % ( 2 * MAP_LIVE );
+    auto it = m.find( key );
+    if( it != m.end() ) m.erase( it );
+    else m.emplace( key, (int) i );
+  }
+}
+
+template <class Vector>
+void vector_growth( std::vector<Vector> &vs ){
+  unsigned int r, i, v;
+
+  for( r = 0; r < VECTOR_ROUNDS; r++ ){
+    for( i = 0; i < VECTOR_LENGTH; i++ )
+      for( v = 0; v < vs.size(); v++ ) vs[v].push_back( (int) i );
+    for( v = 0; v < vs.size(); v++ ){
+      vs[v].clear();
+      vs[v].shrink_to_fit();
+    }
+  }
+}
+
+void report( const char *name, double def, double alloc, double pmr ){
+  printf( "   %-16s default %8.1f ms   heap_allocator %8.1f ms   pmr %8.1f ms\n",
+    name, def, alloc, pmr );
+}
+
+int main(){
+  typedef heap_allocator<std::pair<const int, int>> pair_alloc;
+  alloc_resource heap( REGION_SIZE );
+  double def, alloc, pmr;
+
+  def = time_ms( []{ std::map<int, int> m; map_churn( m ); } );
+  alloc = time_ms( [&]{
+    std::map<int, int, std::less<int>, pair_alloc> m{ pair_alloc( heap ) };
+    map_churn( m ); } );
+  pmr = time_ms( [&]{ std::pmr::map<int, int> m( &heap ); map_churn( m ); } );
+  report( "map churn", def, alloc, pmr );
+
+  def = time_ms( []{ std::unordered_map<int, int> m; map_churn( m ); } );
+  alloc = time_ms( [&]{
+    std::unordered_map<int, int, std::hash<int>, std::equal_to<int>, pair_alloc>
+      m( 0, std::hash<int>(), std::equal_to<int>(), pair_alloc( heap ) );
+    map_churn( m ); } );
+  pmr = time_ms( [&]{ std::pmr::unordered_map<int, int> m( &heap ); map_churn( m ); } );
+  report( "unordered churn", def, alloc, pmr );
+
+  def = time_ms( []{ std::vector<std::vector<int>> vs( VECTORS ); vector_growth( vs ); } );
+  alloc = time_ms( [&]{
+    typedef std::vector<int, heap_allocator<int>> heap_vector;
+    std::vector<heap_vector> vs( VECTORS, heap_vector( heap_allocator<int>( heap ) ) );
+    vector_growth( vs ); } );
+  pmr = time_ms( [&]{
+    std::vector<std::pmr::vector<int>> vs;
+    for( int v = 0; v < VECTORS; v++ ) vs.emplace_back( &heap );
+    vector_growth( vs ); } );
+  report( "vector growth", def, alloc, pmr );
+
+  printf( "   %d bytes free in the heap after the runs\n", free_size() );
+  return 0;
+}
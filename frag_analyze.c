@@ -0,0 +1,131 @@
+/* CPSC/ECE 3220 fragmentation map analyzer
+ *
+ * This program reads the snapshots that frag_dump() in alloc.c appends
+ * to a file and reports, for each snapshot,
+ *
+ *   - the numbers of allocated blocks and free holes and their bytes
+ *   - the largest allocatable request, which is the largest free hole
+ *     (alloc_mem() can hand out a whole free block)
+ *   - external fragmentation, 1 - largest hole / free bytes, which is 0
+ *     when all free memory is in one hole
+ *   - the size distribution of the free holes in power-of-two classes
+ *
+ * and, with a second argument, writes a heat map of occupancy over the
+ * address space as a binary PPM image: each snapshot is a band of
+ * BAND_HEIGHT rows, top to bottom in time order, and each of the
+ * MAP_WIDTH columns covers an equal share of the region, colored from
+ * dark blue (free) to yellow (allocated, tags included) by the fraction
+ * of it that is in allocated blocks.
+ *
+ *   frag_analyze.out frag_map.dat [heat_map.ppm]
+ *
+ * where frag_map.dat comes from running alloc.out with ALLOC_FRAGMAP=
+ * frag_map.dat in its environment.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#define MAP_WIDTH 512
+#define BAND_HEIGHT 8
+#define HOLE_CLASSES 24
+#define MAX_SNAPSHOTS 1024
+
+/* same layout as in alloc.c */
+
+struct frag_header { char magic[8]; uint32_t sequence, blocks; uint64_t region_bytes; };
+struct frag_record { uint32_t offset, size_state; };
+
+unsigned long hole_hist[MAX_SNAPSHOTS][HOLE_CLASSES];
+unsigned char *heat_rows[MAX_SNAPSHOTS];
+
+/* add the allocated span [lo, hi) to the per-column occupancy */
+
+void add_span( double *occupied, uint64_t region_bytes, uint64_t lo, uint64_t hi ){
+  double width = (double) region_bytes / MAP_WIDTH, x0 = lo / width, x1 = hi / width;
+  int c;
+
+  for( c = (int) x0; c < MAP_WIDTH && c < x1; c++ ){
+    double a = ( c > x0 ) ? c : x0, b = ( c + 1 < x1 ) ? c + 1 : x1;
+    occupied[c] += b - a;
+  }
+}
+
+int main( int argc, char *argv[] ){
+  struct frag_header hdr;
+  struct frag_record rec;
+  double occupied[MAP_WIDTH];
+  unsigned long holes, used_blocks, free_bytes, used_bytes, largest, size;
+  unsigned int snapshots = 0, i, c, k, max_class = 0;
+  FILE *fp, *img;
+
+  if( argc < 2 ){
+    printf( "usage: %s frag_map_file [heat_map.ppm]\n", argv[0] );
+    return 1;
+  }
+  fp = fopen( argv[1], "rb" );
+  if( fp == NULL ){ printf( "cannot open %s\n", argv[1] ); return 1; }
+
+  printf( "snapshot   blocks    holes   allocated        free     largest  fragmentation\n" );
+  while( snapshots < MAX_SNAPSHOTS && fread( &hdr, sizeof( hdr ), 1, fp ) == 1 ){
+    if( memcmp( hdr.magic, "fragmap1", 8 ) != 0 || hdr.region_bytes == 0 ){
+      printf( "bad snapshot header\n" );
+      return 1;
+    }
+    holes = used_blocks = free_bytes = used_bytes = largest = 0;
+    memset( occupied, 0, sizeof( occupied ) );
+
+    for( i = 0; i < hdr.blocks; i++ ){
+      if( fread( &rec, sizeof( rec ), 1, fp ) != 1 ){ printf( "short snapshot\n" ); return 1; }
+      size = rec.size_state & ~15U;
+      if( rec.size_state & 1 ){
+        used_blocks++;
+        used_bytes += size;
+        add_span( occupied, hdr.region_bytes, rec.offset, rec.offset + size + 32 );
+      }else{
+        holes++;
+        free_bytes += size;
+        if( size > largest ) largest = size;
+        k = 0;
+        while( k < HOLE_CLASSES - 1 && size > ( 16UL << k ) ) k++;
+        hole_hist[snapshots][k]++;
+        if( k > max_class ) max_class = k;
+      }
+    }
+
+    printf( "%8u %8lu %8lu %11lu %11lu %11lu  %12.3f\n", hdr.sequence,
+      used_blocks + holes, holes, used_bytes, free_bytes, largest,
+      free_bytes ? 1.0 - (double) largest / free_bytes : 0.0 );
+
+    heat_rows[snapshots] = (unsigned char *) malloc( 3 * MAP_WIDTH );
+    if( heat_rows[snapshots] == NULL ){ printf( "no memory!\n" ); return 1; }
+    for( c = 0; c < MAP_WIDTH; c++ ){
+      double f = occupied[c] > 1.0 ? 1.0 : occupied[c];
+      heat_rows[snapshots][3 * c] = (unsigned char) ( 255 * f );
+      heat_rows[snapshots][3 * c + 1] = (unsigned char) ( 220 * f );
+      heat_rows[snapshots][3 * c + 2] = (unsigned char) ( 96 * ( 1 - f ) );
+    }
+    snapshots++;
+  }
+  fclose( fp );
+
+  printf( "\nfree holes by size (columns are snapshots)\n" );
+  for( k = 0; k <= max_class; k++ ){
+    printf( "   <= %-9lu", 16UL << k );
+    for( i = 0; i < snapshots; i++ ) printf( " %6lu", hole_hist[i][k] );
+    printf( "\n" );
+  }
+
+  if( argc > 2 ){
+    img = fopen( argv[2], "wb" );
+    if( img == NULL ){ printf( "cannot open %s\n", argv[2] ); return 1; }
+    fprintf( img, "P6\n%d %u\n255\n", MAP_WIDTH, snapshots * BAND_HEIGHT );
+    for( i = 0; i < snapshots; i++ )
+      for( k = 0; k < BAND_HEIGHT; k++ ) fwrite( heat_rows[i], 3, MAP_WIDTH, img );
+    fclose( img );
+    printf( "\nheat map of %u snapshots written to %s\n", snapshots, argv[2] );
+  }
+  return 0;
+}
@@ -0,0 +1,187 @@
+/* CPSC/ECE 3220 compressed handle benchmark
+ *
+ * This driver builds an unbalanced binary search tree of TREE_NODES
+ * random keys on the heap of alloc.c and then looks up LOOKUPS random
+ * keys, with two kinds of node:
+ *
+ *   pointer   left and right links are 8-byte pointers (24-byte node)
+ *   handle    left and right links are heap_handle.hpp handles
+ *             (12-byte node)
+ *
+ * each taken from a block of its own from alloc_mem() and from an
+ * ObjectPool (object_pool.hpp, a HandlePool for the handle node) on the
+ * same heap, and reports the build and lookup times and the heap bytes
+ * per node. Every block carries 32 bytes of tags, so the smaller node
+ * shows most clearly in the pool, where slots have no tags.
+ *
+ * It then checks that a 24-byte object from a plain ObjectPool, whose
+ * odd slots are 8 bytes off a 16-byte boundary, and an interior pointer
+ * are refused a handle, and that every object of a HandlePool of the
+ * same type gets one that decodes back to it.
+ */
+
+#include <cstdio>
+#include <chrono>
+#include <functional>
+#include <stdexcept>
+#include "alloc_resource.hpp"
+#include "object_pool.hpp"
+#include "heap_handle.hpp"
+
+#define REGION_SIZE (128 * 1024 * 1024)
+#define TREE_NODES 500000
+#define LOOKUPS 2000000
+
+struct ptr_node {
+  typedef ptr_node *link;
+  typedef ObjectPool<ptr_node> pool;
+  link left = nullptr, right = nullptr;
+  int key;
+  explicit ptr_node( int k ) : key( k ) {}
+};
+
+struct handle_node {
+  typedef heap_handle<handle_node> link;
+  typedef HandlePool<handle_node> pool;
+  link left, right;
+  int key;
+  explicit handle_node( int k ) : key( k ) {}
+};
+
+template <class T> T *deref( T *p ){ return p; }
+template <class T> T *deref( heap_handle<T> h ){ return h.get(); }
+
+unsigned int bench_seed;
+
+unsigned int bench_random(){
+  bench_seed = bench_seed * 1103515245 + 12345;
+  return ( bench_seed >> 8 );
+}
+
+double time_ms( const std::function<void()> &work ){
+  auto t0 = std::chrono::steady_clock::now();
+  work();
+  auto t1 = std::chrono::steady_clock::now();
+  return std::chrono::duration<double, std::milli>( t1 - t0 ).count();
+}
+
+template <class Node, class Make>
+typename Node::link build_tree( Make make, unsigned int &nodes ){
+  typename Node::link root{}, *at;
+  Node *n;
+  unsigned int i;
+  int key;
+
+  bench_seed = 12345;
+  nodes = 0;
+  for( i = 0; i < TREE_NODES; i++ ){
+    key = (int) bench_random();
+    for( at = &root; ( n = deref( *at ) ) != nullptr && n->key != key; )
+      at = ( key < n->key ) ? &n->left : &n->right;
+    if( n != nullptr ) continue;
+    *at = typename Node::link( make( key ) );
+    nodes++;
+  }
+  return root;
+}
+
+template <class Node>
+unsigned long lookup( typename Node::link root ){
+  unsigned long found = 0;
+  unsigned int i;
+  Node *n;
+  int key;
+
+  // half of the keys are in the tree
+  for( i = 0; i < LOOKUPS; i++ ){
+    if( i % TREE_NODES == 0 ) bench_seed = 12345 + i / TREE_NODES % 2;
+    key = (int) bench_random();
+    for( n = deref( root ); n != nullptr && n->key != key; )
+      n = deref( ( key < n->key ) ? n->left : n->right );
+    if( n != nullptr ) found++;
+  }
+  return found;
+}
+
+template <class Node>
+void release_tree( typename Node::link root ){
+  Node *n = deref( root );
+
+  if( n == nullptr ) return;
+  release_tree<Node>( n->left );
+  release_tree<Node>( n->right );
+  n->~Node();
+  release_mem( n );
+}
+
+template <class Node>
+void run( alloc_resource &heap, const char *links, bool pooled ){
+  typename Node::link root{};
+  unsigned int nodes = 0;
+  unsigned long found = 0;
+  int before = free_size(), used;
+  double build, search;
+  typename Node::pool pool( heap, 1024, 65536 );
+
+  build = time_ms( [&]{
+    if( pooled ) root = build_tree<Node>( [&]( int key ){ return pool.create( key ); }, nodes );
+    else root = build_tree<Node>( []( int key ){
+      void *p = alloc_mem( sizeof( Node ) );
+      if( p == nullptr ) throw std::bad_alloc();
+      return ::new ( p ) Node( key ); }, nodes ); } );
+  used = before - free_size();
+  search = time_ms( [&]{ found = lookup<Node>( root ); } );
+  // the pool gives its chunks back when it goes out of scope
+  if( !pooled ) release_tree<Node>( root );
+  printf( "   %-8s %-11s %9.1f %10.1f %10.1f %9lu\n", links, pooled ? "ObjectPool" : "alloc_mem",
+    build, search, (double) used / nodes, found );
+}
+
+/* 1 if ptr is refused a handle */
+
+template <class T>
+int refused( T *ptr ){
+  try {
+    heap_handle<T> h( ptr );
+  } catch( const std::invalid_argument & ) {
+    return 1;
+  }
+  return 0;
+}
+
+void check_handles( alloc_resource &heap ){
+  ObjectPool<ptr_node> plain( heap, 8 );
+  HandlePool<ptr_node> rounded( heap, 8 );
+  ptr_node *p[8];
+  int i, bad = 0;
+
+  for( i = 0; i < 8; i++ ) p[i] = plain.create( i );
+  printf( "   ObjectPool<24-byte node>: %d of 8 objects refused a handle\n",
+    refused( p[0] ) + refused( p[1] ) + refused( p[2] ) + refused( p[3] )
+    + refused( p[4] ) + refused( p[5] ) + refused( p[6] ) + refused( p[7] ) );
+  printf( "   interior pointer %s a handle\n",
+    refused( reinterpret_cast<ptr_node *>( reinterpret_cast<char *>( p[0] ) + 8 ) ) ? "refused" : "*** given" );
+  for( i = 0; i < 8; i++ ) plain.destroy( p[i] );
+
+  for( i = 0; i < 8; i++ ){
+    p[i] = rounded.create( i );
+    if( refused( p[i] ) || heap_handle<ptr_node>( p[i] ).get() != p[i] ) bad++;
+  }
+  printf( "   HandlePool<24-byte node>: %d of 8 objects without a handle, %zu-byte slots\n",
+    bad, HandlePool<ptr_node>::slot_bytes );
+  for( i = 0; i < 8; i++ ) rounded.destroy( p[i] );
+}
+
+int main(){
+  alloc_resource heap( REGION_SIZE );
+
+  printf( "   %u nodes, %u lookups\n", TREE_NODES, LOOKUPS );
+  printf( "   links    memory       build ms  lookup ms bytes/node     found\n" );
+  run<ptr_node>( heap, "pointer", false );
+  run<handle_node>( heap, "handle", false );
+  run<ptr_node>( heap, "pointer", true );
+  run<handle_node>( heap, "handle", true );
+  printf( "   %d bytes free in the heap after the runs\n", free_size() );
+  check_handles( heap );
+  return 0;
+}
@@ -0,0 +1,141 @@
+/* CPSC/ECE 3220 compressed heap handles
+ *
+ * heap_handle<T> names an object in the region of alloc.c by a 32-bit
+ * handle, its offset from region_base divided by 16, instead of a
+ * 64-bit pointer. Payloads are 16-byte aligned, so decoding is just
+ * region_base + ( h << 4 ), done inline here; handle 0 is null. Links
+ * in tree and graph nodes then take half the space:
+ *
+ *   struct node { int key; heap_handle<node> left, right; };  // 12 bytes
+ *
+ *   heap_handle<node> n = make_handle<node>( 42 );   // alloc_mem() + node( 42 )
+ *   n->left = make_handle<node>( 7 );
+ *   destroy_handle( n );                             // ~node() + release_mem()
+ *
+ *   unique_handle<T>  owns its object as std::unique_ptr does and
+ *                     destroys it when it goes out of scope; it is 4
+ *                     bytes too
+ *
+ * A handle is only meaningful for the region it was made in, and only
+ * while that region is alive. make_handle() throws std::bad_alloc when
+ * alloc_mem() returns NULL. Types aligned beyond 16 bytes are rejected
+ * at compile time.
+ *
+ * Only a pointer to a 16-byte boundary inside the region has a handle;
+ * like ptr_to_handle() in alloc.c, heap_handle( ptr ) rejects any other
+ * pointer (an interior pointer, a tiny tier object, a slot of a pool
+ * whose slots are not multiples of 16 bytes, memory outside the region)
+ * by throwing std::invalid_argument instead of encoding a handle to the
+ * wrong place. Blocks from make_handle() always qualify; pool objects
+ * qualify when the pool is a HandlePool<T>, an ObjectPool whose slots
+ * are rounded up to 16 bytes:
+ *
+ *   HandlePool<node> pool( heap );
+ *   heap_handle<node> n( pool.create( 42 ) );
+ */
+
+#ifndef HEAP_HANDLE_HPP
+#define HEAP_HANDLE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <stdexcept>
+#include <utility>
+#include "object_pool.hpp"
+
+extern "C" {
+  extern char *region_base;
+  extern std::size_t region_length;
+  void *alloc_mem( unsigned int amount );
+  unsigned int release_mem( void *ptr );
+}
+
+template <class T>
+class heap_handle {
+public:
+  heap_handle() noexcept = default;
+  heap_handle( std::nullptr_t ) noexcept {}
+  explicit heap_handle( T *ptr ) : h_( encode( ptr ) ) {}
+
+  static heap_handle from_raw( std::uint32_t h ) noexcept { heap_handle r; r.h_ = h; return r; }
+  std::uint32_t raw() const noexcept { return h_; }
+
+  T *get() const noexcept {
+    return h_ ? reinterpret_cast<T *>( region_base + ( (std::size_t) h_ << 4 ) ) : nullptr;
+  }
+  T &operator*() const noexcept { return *get(); }
+  T *operator->() const noexcept { return get(); }
+  explicit operator bool() const noexcept { return h_ != 0; }
+
+  bool operator==( const heap_handle &other ) const noexcept { return h_ == other.h_; }
+  bool operator!=( const heap_handle &other ) const noexcept { return h_ != other.h_; }
+
+private:
+  static std::uint32_t encode( T *ptr ){
+    std::uintptr_t off = reinterpret_cast<std::uintptr_t>( ptr ) - reinterpret_cast<std::uintptr_t>( region_base );
+
+    if( ptr == nullptr ) return 0;
+    if( off == 0 || off >= region_length || off % 16 != 0 )
+      throw std::invalid_argument( "heap_handle: pointer is not a 16-byte boundary in the region" );
+    return (std::uint32_t) ( off >> 4 );
+  }
+
+  std::uint32_t h_ = 0;
+};
+
+template <class T>
+using HandlePool = ObjectPool<T, 16>;
+
+template <class T, class... Args>
+heap_handle<T> make_handle( Args &&... args ){
+  static_assert( alignof( T ) <= 16, "heap blocks are only 16-byte aligned" );
+  void *ptr = alloc_mem( sizeof( T ) );
+
+  if( ptr == nullptr ) throw std::bad_alloc();
+  try {
+    return heap_handle<T>( ::new ( ptr ) T( std::forward<Args>( args )... ) );
+  } catch( ... ) {
+    release_mem( ptr );
+    throw;
+  }
+}
+
+template <class T>
+void destroy_handle( heap_handle<T> h ){
+  if( !h ) return;
+  h->~T();
+  release_mem( h.get() );
+}
+
+template <class T>
+class unique_handle {
+public:
+  unique_handle() noexcept = default;
+  explicit unique_handle( heap_handle<T> h ) noexcept : h_( h ) {}
+  unique_handle( unique_handle &&other ) noexcept : h_( other.release() ) {}
+  unique_handle &operator=( unique_handle &&other ) noexcept {
+    if( this != &other ) reset( other.release() );
+    return *this;
+  }
+  ~unique_handle(){ destroy_handle( h_ ); }
+
+  unique_handle( const unique_handle & ) = delete;
+  unique_handle &operator=( const unique_handle & ) = delete;
+
+  heap_handle<T> get() const noexcept { return h_; }
+  heap_handle<T> release() noexcept { heap_handle<T> h = h_; h_ = nullptr; return h; }
+  void reset( heap_handle<T> h = nullptr ){ destroy_handle( h_ ); h_ = h; }
+
+  T &operator*() const noexcept { return *h_; }
+  T *operator->() const noexcept { return h_.get(); }
+  explicit operator bool() const noexcept { return (bool) h_; }
+
+private:
+  heap_handle<T> h_;
+};
+
+static_assert( sizeof( heap_handle<int> ) == 4 && sizeof( unique_handle<int> ) == 4,
+  "handles must stay 32 bits" );
+
+#endif
@@ -0,0 +1,105 @@
+/* CPSC/ECE 3220 false sharing benchmark
+ *
+ * This driver is linked with alloc.c (compiled with -DBENCH). Each of
+ * THREADS threads increments a counter of its own INCREMENTS times,
+ * with the counters placed
+ *
+ *   one line            all in one 64-byte block, the worst case of
+ *                       per-thread state packed into one allocation,
+ *                       so the line moves between cores on every
+ *                       increment
+ *   alloc_mem           one block each, allocated one after another;
+ *                       the blocks are 48 bytes apart, so some pairs of
+ *                       neighbors share a line
+ *   alloc_mem_isolated  one block each, with a cache line to itself
+ *
+ * It reports the pairs of counters that share a line, the wall time of
+ * the run divided by INCREMENTS (the time one thread takes per
+ * increment, since the threads run side by side) and the heap bytes
+ * taken per counter. The gain needs the threads to run on different
+ * cores; on a single core the three runs take about the same time.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <time.h>
+
+#define REGION_SIZE (1024 * 1024)
+#define THREADS 4
+#define INCREMENTS 50000000
+#define CACHE_LINE 64
+
+void init_region_size( unsigned int size );
+void release_region();
+void *alloc_mem( unsigned int amount );
+void *alloc_mem_isolated( unsigned int amount );
+unsigned int release_mem( void *ptr );
+int free_size();
+
+double now_ns(){
+  struct timespec ts;
+
+  clock_gettime( CLOCK_MONOTONIC, &ts );
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+volatile long *counter[THREADS];
+
+void *count( void *arg ){
+  volatile long *c = counter[(intptr_t) arg];
+  long i;
+
+  for( i = 0; i < INCREMENTS; i++ ) ( *c )++;
+  return NULL;
+}
+
+#define ONE_LINE 0
+#define SEPARATE 1
+#define ISOLATED 2
+
+void run( const char *name, int placement ){
+  pthread_t tid[THREADS];
+  int before, i, j, shared = 0;
+  char *line = NULL;
+  double t;
+
+  init_region_size( REGION_SIZE );
+  before = free_size();
+  if( placement == ONE_LINE ){
+    line = (char *) alloc_mem_isolated( THREADS * sizeof( long ) );
+    if( line == NULL ){ printf( "no memory!\n" ); exit(0); }
+  }
+  for( i = 0; i < THREADS; i++ ){
+    if( placement == ONE_LINE ) counter[i] = (volatile long *) line + i;
+    else if( placement == SEPARATE ) counter[i] = (volatile long *) alloc_mem( sizeof( long ) );
+    else counter[i] = (volatile long *) alloc_mem_isolated( sizeof( long ) );
+    if( counter[i] == NULL ){ printf( "no memory!\n" ); exit(0); }
+    *counter[i] = 0;
+  }
+  for( i = 0; i < THREADS; i++ )
+    for( j = i + 1; j < THREADS; j++ )
+      if( (uintptr_t) counter[i] / CACHE_LINE == (uintptr_t) counter[j] / CACHE_LINE ) shared++;
+
+  t = now_ns();
+  for( i = 0; i < THREADS; i++ ) pthread_create( &tid[i], NULL, count, (void *) (intptr_t) i );
+  for( i = 0; i < THREADS; i++ ) pthread_join( tid[i], NULL );
+  t = now_ns() - t;
+
+  for( i = 0; i < THREADS; i++ )
+    if( *counter[i] != INCREMENTS ) printf( "*** counter %d is %ld\n", i, *counter[i] );
+  printf( "   %-19s %d of %d pairs share a line, %6.2f ns/increment, %d heap bytes per counter\n", name,
+    shared, THREADS * ( THREADS - 1 ) / 2, t / INCREMENTS, ( before - free_size() ) / THREADS );
+  if( placement == ONE_LINE ) release_mem( line );
+  else for( i = 0; i < THREADS; i++ ) release_mem( (void *) counter[i] );
+  release_region();
+}
+
+int main(){
+  printf( "   %d threads, %d increments each\n", THREADS, INCREMENTS );
+  run( "one line", ONE_LINE );
+  run( "alloc_mem", SEPARATE );
+  run( "alloc_mem_isolated", ISOLATED );
+  return 0;
+}
@@ -0,0 +1,133 @@
+/* CPSC/ECE 3220 lifetime segregation benchmark
+ *
+ * This driver is linked with alloc.c (compiled with -DBENCH) and runs a
+ * server-like mix of requests on one region:
+ *
+ *   request buffers  REQUEST_MIN to REQUEST_MAX bytes, kept in a FIFO
+ *                    of IN_FLIGHT buffers and released when they leave
+ *                    it, so each lives for a few hundred allocations
+ *   cache entries    CACHE_MIN to CACHE_MAX bytes, added with
+ *                    probability 1 in CACHE_RATE until CACHE_ENTRIES
+ *                    are live, then one random entry is evicted for each
+ *                    one added
+ *
+ * three times over:
+ *
+ *   mixed    every block from alloc_mem()
+ *   hinted   alloc_mem_life() with LIFE_SHORT for buffers and LIFE_LONG
+ *            for cache entries
+ *   auto     alloc_mem_life( amount, LIFE_AUTO ) for both, with
+ *            life_learn( 1 ) at the start
+ *
+ * At every CHECKPOINT allocations it prints the largest free block,
+ * which is the largest request the heap can still meet, and the free
+ * bytes, and at the end the number of requests that found no block
+ * large enough. Cache entries that survive between buffers break the
+ * free space into holes in the mixed run; the other two should keep
+ * one large block.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define REGION_SIZE (16 * 1024 * 1024)
+#define REQUEST_MIN 512
+#define REQUEST_MAX 8192
+#define IN_FLIGHT 256
+#define CACHE_MIN 64
+#define CACHE_MAX 256
+#define CACHE_ENTRIES 20000
+#define CACHE_RATE 4
+#define ALLOCATIONS 400000
+#define CHECKPOINT 50000
+
+#define LIFE_AUTO 0
+#define LIFE_SHORT 1
+#define LIFE_LONG 2
+
+void init_region_size( unsigned int size );
+void release_region();
+void *alloc_mem( unsigned int amount );
+void *alloc_mem_life( unsigned int amount, int life );
+unsigned int release_mem( void *ptr );
+int free_size();
+unsigned int largest_free();
+void life_learn( int on );
+
+unsigned int bench_seed;
+
+unsigned int bench_random(){
+  bench_seed = bench_seed * 1103515245 + 12345;
+  return ( bench_seed >> 8 );
+}
+
+double now_ns(){
+  struct timespec ts;
+
+  clock_gettime( CLOCK_MONOTONIC, &ts );
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+void *in_flight[IN_FLIGHT];
+void *cache[CACHE_ENTRIES];
+unsigned int largest[ALLOCATIONS / CHECKPOINT][3];
+int free_bytes[ALLOCATIONS / CHECKPOINT][3];
+unsigned long failed[3];
+const char *mode_names[3] = { "mixed", "hinted", "auto" };
+
+void *take( int mode, unsigned int amount, int life ){
+  void *p;
+
+  if( mode == 0 ) p = alloc_mem( amount );
+  else p = alloc_mem_life( amount, ( mode == 1 ) ? life : LIFE_AUTO );
+  if( p == NULL ) failed[mode]++;
+  return p;
+}
+
+void run( int mode ){
+  unsigned int i, head = 0, cached = 0, s;
+  double t;
+
+  init_region_size( REGION_SIZE );
+  bench_seed = 12345;
+  if( mode == 2 ) life_learn( 1 );
+  t = now_ns();
+  for( i = 0; i < ALLOCATIONS; i++ ){
+    if( bench_random() % CACHE_RATE == 0 ){
+      s = ( cached < CACHE_ENTRIES ) ? cached++ : bench_random() % CACHE_ENTRIES;
+      if( cache[s] != NULL ) release_mem( cache[s] );
+      cache[s] = take( mode, CACHE_MIN + bench_random() % ( CACHE_MAX - CACHE_MIN + 1 ), LIFE_LONG );
+    }else{
+      if( in_flight[head] != NULL ) release_mem( in_flight[head] );
+      in_flight[head] = take( mode, REQUEST_MIN + bench_random() % ( REQUEST_MAX - REQUEST_MIN + 1 ), LIFE_SHORT );
+      head = ( head + 1 ) % IN_FLIGHT;
+    }
+    if( ( i + 1 ) % CHECKPOINT == 0 ){
+      largest[i / CHECKPOINT][mode] = largest_free();
+      free_bytes[i / CHECKPOINT][mode] = free_size();
+    }
+  }
+  printf( "   %-7s %6.0f ns per allocation, %lu requests failed\n", mode_names[mode],
+    ( now_ns() - t ) / ALLOCATIONS, failed[mode] );
+  if( mode == 2 ) life_learn( 0 );
+  for( i = 0; i < IN_FLIGHT; i++ ) in_flight[i] = NULL;
+  for( i = 0; i < CACHE_ENTRIES; i++ ) cache[i] = NULL;
+  release_region();
+}
+
+int main(){
+  unsigned int c;
+  int mode;
+
+  for( mode = 0; mode < 3; mode++ ) run( mode );
+  printf( "\n   largest free block / free bytes, in KiB\n" );
+  printf( "   allocations       mixed          hinted            auto\n" );
+  for( c = 0; c < ALLOCATIONS / CHECKPOINT; c++ ){
+    printf( "   %11u", ( c + 1 ) * CHECKPOINT );
+    for( mode = 0; mode < 3; mode++ )
+      printf( "   %5u / %5d", largest[c][mode] / 1024, free_bytes[c][mode] / 1024 );
+    printf( "\n" );
+  }
+  return 0;
+}
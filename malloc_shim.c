@@ -0,0 +1,321 @@
+/* CPSC/ECE 3220 malloc shim
+ *
+ * This library puts the allocator of alloc.c under unmodified programs.
+ * It exports malloc(), free(), calloc(), realloc(), posix_memalign(),
+ * aligned_alloc(), memalign(), valloc(), pvalloc() and
+ * malloc_usable_size(), so that
+ *
+ *   LD_PRELOAD=./malloc_shim.so program arguments
+ *
+ * runs the program on alloc_mem() and release_mem(). It is built from
+ * this file and alloc.c compiled with -DSHIM (see the makefile), which
+ * hides every symbol of alloc.c from the program.
+ *
+ *   - the heap is a REGION_RESERVE region of SHIM_REGION_SIZE bytes,
+ *     so it grows by committing pages as it is used and its address
+ *     range never moves
+ *   - requests above SHIM_MMAP_THRESHOLD bytes, and requests the heap
+ *     cannot satisfy, get a mapping of their own, which is recorded in
+ *     a table keyed by the user pointer (see big mappings below)
+ *   - a pointer that is in none of the heap, the bootstrap area and the
+ *     table is not ours; free() and realloc() pass it to glibc's
+ *     __libc_free() and __libc_realloc(), which check it and abort on a
+ *     bad one, and malloc_usable_size() returns 0 for it
+ *   - one mutex serializes the heap; it is held across fork() so that
+ *     the child starts with a consistent heap and an unlocked mutex
+ *   - a thread that calls malloc() again while it is inside the heap
+ *     (for example glibc allocating for pthread_atfork() during the
+ *     first call) is served from a static bootstrap area; memory from
+ *     that area is never given back
+ *
+ * Every pointer returned is at least 16-byte aligned, so the tiny tier
+ * of alloc.c, whose payloads are byte aligned, is not used.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+
+#define SHIM_REGION_SIZE 0xf0000000U
+#define SHIM_MMAP_THRESHOLD (1024 * 1024)
+#define BOOTSTRAP_SIZE (64 * 1024)
+#define BIG_TABLE_MIN 256
+#define REGION_RESERVE 2
+
+#define EXPORT __attribute__ ((visibility ("default")))
+
+void init_region_mode( unsigned int size, int mode );
+void *alloc_mem( unsigned int amount );
+void *alloc_mem_aligned( unsigned int amount, unsigned int align );
+unsigned int release_mem( void *ptr );
+extern char *region_base;
+extern size_t region_length;
+void __libc_free( void *ptr );
+void *__libc_realloc( void *ptr, size_t size );
+
+char bootstrap[BOOTSTRAP_SIZE] __attribute__ ((aligned (64)));
+size_t bootstrap_used;
+
+pthread_mutex_t shim_lock = PTHREAD_MUTEX_INITIALIZER;
+int shim_ready = 0;
+__thread int shim_busy __attribute__ ((tls_model ("initial-exec")));
+
+#define IN_REGION(p) (region_base != NULL && (char *)(p) >= region_base && \
+  (char *)(p) < region_base + region_length)
+#define IN_BOOTSTRAP(p) ((char *)(p) >= bootstrap && (char *)(p) < bootstrap + BOOTSTRAP_SIZE)
+
+
+/* bootstrap area: a bump allocator with the size kept in the 16 bytes
+ * in front of each block */
+
+void *bootstrap_alloc( size_t size, size_t align ){
+  size_t start;
+
+  if( align < 16 ) align = 16;
+  start = ( bootstrap_used + 16 + align - 1 ) & ~( align - 1 );
+  if( start + size > BOOTSTRAP_SIZE ) return NULL;
+  *(size_t *) ( bootstrap + start - 16 ) = size;
+  bootstrap_used = start + size;
+  return bootstrap + start;
+}
+
+/* big mappings
+ *
+ *   every mapping made by big_alloc() has an entry in big_table, an
+ *   open-addressing hash table keyed by the user pointer like the free
+ *   block index of alloc.c, so a pointer is found to be a big chunk
+ *   without reading the memory in front of it; the table is a mapping
+ *   of its own, doubled when it is half full, and big_lock guards it
+ */
+
+struct big_chunk { char *user; char *map; size_t length; };
+
+struct big_chunk *big_table;
+size_t big_mask, big_count;
+pthread_mutex_t big_lock = PTHREAD_MUTEX_INITIALIZER;
+
+#define BIG_HASH(p) ((((uintptr_t)(p) >> 12) * 2654435761U) & big_mask)
+
+void big_put( struct big_chunk *c ){
+  size_t h = BIG_HASH( c->user );
+  while( big_table[h].user != NULL ) h = ( h + 1 ) & big_mask;
+  big_table[h] = *c;
+}
+
+/* add an entry, doubling the table first if it is half full; returns 0,
+ * or -1 if the table cannot grow */
+
+int big_record( char *user, char *map, size_t length ){
+  struct big_chunk *old = big_table, c;
+  size_t old_size = ( old != NULL ) ? big_mask + 1 : 0, size, i;
+  void *table;
+
+  if( 2 * ( big_count + 1 ) > old_size ){
+    size = ( old_size != 0 ) ? 2 * old_size : BIG_TABLE_MIN;
+    table = mmap( NULL, size * sizeof( struct big_chunk ), PROT_READ | PROT_WRITE,
+      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 );
+    if( table == MAP_FAILED ) return -1;
+    big_table = (struct big_chunk *) table;
+    big_mask = size - 1;
+    for( i = 0; i < old_size; i++ ) if( old[i].user != NULL ) big_put( &old[i] );
+    if( old != NULL ) munmap( old, old_size * sizeof( struct big_chunk ) );
+  }
+  c.user = user;
+  c.map = map;
+  c.length = length;
+  big_put( &c );
+  big_count++;
+  return 0;
+}
+
+/* return the entry of a user pointer, or NULL if it has none */
+
+struct big_chunk *big_find( void *ptr ){
+  size_t h;
+
+  if( big_table == NULL ) return NULL;
+  for( h = BIG_HASH( ptr ); big_table[h].user != NULL; h = ( h + 1 ) & big_mask )
+    if( big_table[h].user == ptr ) return &big_table[h];
+  return NULL;
+}
+
+/* remove an entry by shifting later members of its probe run back */
+
+void big_delete( struct big_chunk *c ){
+  size_t h = c - big_table, j = h, home;
+
+  big_count--;
+  for( ;; ){
+    big_table[h].user = NULL;
+    do {
+      j = ( j + 1 ) & big_mask;
+      if( big_table[j].user == NULL ) return;
+      home = BIG_HASH( big_table[j].user );
+    } while( ( h <= j ) ? ( h < home && home <= j ) : ( h < home || home <= j ) );
+    big_table[h] = big_table[j];
+    h = j;
+  }
+}
+
+/* requests outside the heap get a mapping of their own */
+
+void *big_alloc( size_t size, size_t align ){
+  size_t page = sysconf( _SC_PAGESIZE ), len;
+  char *map, *user;
+  int rc;
+
+  if( align < 16 ) align = 16;
+  if( size > SIZE_MAX - align - page ) return NULL;
+  len = ( size + ( align > page ? align : 0 ) + page - 1 ) & ~( page - 1 );
+  map = (char *) mmap( NULL, len, PROT_READ | PROT_WRITE,
+    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 );
+  if( map == MAP_FAILED ) return NULL;
+  user = (char *) ( ( (uintptr_t) map + align - 1 ) & ~(uintptr_t) ( align - 1 ) );
+  pthread_mutex_lock( &big_lock );
+  rc = big_record( user, map, len );
+  pthread_mutex_unlock( &big_lock );
+  if( rc != 0 ){ munmap( map, len ); return NULL; }
+  return user;
+}
+
+
+void shim_prepare(){ pthread_mutex_lock( &shim_lock ); pthread_mutex_lock( &big_lock ); }
+void shim_parent(){ pthread_mutex_unlock( &big_lock ); pthread_mutex_unlock( &shim_lock ); }
+void shim_child(){ pthread_mutex_init( &shim_lock, NULL ); pthread_mutex_init( &big_lock, NULL ); }
+
+/* allocate "size" bytes at a multiple of "align" (a power of two) */
+
+void *shim_alloc( size_t size, size_t align ){
+  void *ptr = NULL;
+
+  if( size == 0 ) size = 1;
+  if( shim_busy ) return bootstrap_alloc( size, align );
+
+  if( size <= SHIM_MMAP_THRESHOLD && align <= SHIM_MMAP_THRESHOLD ){
+    shim_busy = 1;
+    pthread_mutex_lock( &shim_lock );
+    if( !shim_ready ){
+      init_region_mode( SHIM_REGION_SIZE, REGION_RESERVE );
+      pthread_atfork( shim_prepare, shim_parent, shim_child );
+      shim_ready = 1;
+    }
+    if( align <= 16 ) ptr = alloc_mem( size );
+    else ptr = alloc_mem_aligned( size, align );
+    pthread_mutex_unlock( &shim_lock );
+    shim_busy = 0;
+  }
+  if( ptr == NULL ) ptr = big_alloc( size, align );
+  if( ptr == NULL ) errno = ENOMEM;
+  return ptr;
+}
+
+/* return the usable size of a block, or 0 for a foreign pointer (every
+ * block of ours has at least one usable byte) */
+
+size_t shim_usable( void *ptr ){
+  struct big_chunk *c;
+  size_t size = 0;
+
+  if( IN_BOOTSTRAP( ptr ) ) return *(size_t *) ( (char *) ptr - 16 );
+  if( IN_REGION( ptr ) ) return ( (unsigned int *) ptr )[-1];
+  pthread_mutex_lock( &big_lock );
+  c = big_find( ptr );
+  if( c != NULL ) size = c->length - ( c->user - c->map );
+  pthread_mutex_unlock( &big_lock );
+  return size;
+}
+
+
+EXPORT void *malloc( size_t size ){
+  return shim_alloc( size, 16 );
+}
+
+EXPORT void free( void *ptr ){
+  struct big_chunk *c;
+  char *map = NULL;
+  size_t length = 0;
+
+  if( ptr == NULL || IN_BOOTSTRAP( ptr ) ) return;
+  if( IN_REGION( ptr ) ){
+    if( shim_busy ) return;
+    pthread_mutex_lock( &shim_lock );
+    release_mem( ptr );
+    pthread_mutex_unlock( &shim_lock );
+    return;
+  }
+  pthread_mutex_lock( &big_lock );
+  c = big_find( ptr );
+  if( c != NULL ){
+    map = c->map;
+    length = c->length;
+    big_delete( c );
+  }
+  pthread_mutex_unlock( &big_lock );
+  if( map != NULL ) munmap( map, length );
+  else __libc_free( ptr );
+}
+
+EXPORT void *calloc( size_t count, size_t size ){
+  size_t total;
+  void *ptr;
+
+  if( __builtin_mul_overflow( count, size, &total ) ){ errno = ENOMEM; return NULL; }
+  ptr = shim_alloc( total, 16 );
+  // a fresh mapping is already zero; heap blocks may be reused
+  if( ptr != NULL && ( IN_REGION( ptr ) || IN_BOOTSTRAP( ptr ) ) ) memset( ptr, 0, total );
+  return ptr;
+}
+
+EXPORT void *realloc( void *ptr, size_t size ){
+  size_t old;
+  void *new_ptr;
+
+  if( ptr == NULL ) return shim_alloc( size, 16 );
+  if( size == 0 ){ free( ptr ); return NULL; }
+
+  old = shim_usable( ptr );
+  if( old == 0 ) return __libc_realloc( ptr, size );
+  if( size <= old && !IN_BOOTSTRAP( ptr ) ) return ptr;
+  new_ptr = shim_alloc( size, 16 );
+  if( new_ptr == NULL ) return NULL;
+  memcpy( new_ptr, ptr, old < size ? old : size );
+  free( ptr );
+  return new_ptr;
+}
+
+EXPORT int posix_memalign( void **result, size_t align, size_t size ){
+  void *ptr;
+
+  if( align < sizeof( void * ) || ( align & ( align - 1 ) ) != 0 ) return EINVAL;
+  ptr = shim_alloc( size, align );
+  if( ptr == NULL ) return ENOMEM;
+  *result = ptr;
+  return 0;
+}
+
+EXPORT void *aligned_alloc( size_t align, size_t size ){
+  if( align == 0 || ( align & ( align - 1 ) ) != 0 ){ errno = EINVAL; return NULL; }
+  return shim_alloc( size, align );
+}
+
+EXPORT void *memalign( size_t align, size_t size ){
+  return aligned_alloc( align, size );
+}
+
+EXPORT void *valloc( size_t size ){
+  return shim_alloc( size, sysconf( _SC_PAGESIZE ) );
+}
+
+EXPORT void *pvalloc( size_t size ){
+  size_t page = sysconf( _SC_PAGESIZE );
+  return shim_alloc( ( size + page - 1 ) & ~( page - 1 ), page );
+}
+
+EXPORT size_t malloc_usable_size( void *ptr ){
+  return ( ptr == NULL ) ? 0 : shim_usable( ptr );
+}
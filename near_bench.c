@@ -0,0 +1,168 @@
+/* CPSC/ECE 3220 locality benchmark
+ *
+ * This driver is linked with alloc.c (compiled with -DBENCH) and
+ * compares alloc_mem() with alloc_mem_near() for linked structures
+ * built on a fragmented heap that other work keeps churning:
+ *
+ *   1) fill FILL_SLOTS slots with blocks of random size and release a
+ *      random half of them, leaving holes all over the region
+ *   2) build a list of LIST_NODES nodes, each hinted by the previous
+ *      node, and a binary search tree of TREE_NODES random keys, each
+ *      hinted by its parent; after every node a random slot is
+ *      released and refilled, as unrelated requests would do
+ *   3) walk the list TRAVERSALS times and look up every key of the
+ *      tree in insertion order
+ *
+ * For each structure it reports the mean distance from a node to the
+ * next node of the list (or to its parent in the tree), the share of
+ * links that leave the node's page and the pages on either side (far
+ * links), and the time per node visited. Both runs start from a fresh
+ * region and see the same sequence of requests.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define REGION_SIZE (64 * 1024 * 1024)
+#define FILL_SLOTS 100000
+#define MAX_REQUEST 1024
+#define LIST_NODES 200000
+#define TREE_NODES 200000
+#define TRAVERSALS 20
+#define PAGE 4096
+
+void init_region_size( unsigned int size );
+void release_region();
+void *alloc_mem( unsigned int amount );
+void *alloc_mem_near( void *hint, unsigned int amount );
+unsigned int release_mem( void *ptr );
+extern unsigned long near_hits, near_misses;
+
+struct list_node { struct list_node *next; long key; };
+struct tree_node { struct tree_node *left, *right; long key; };
+
+unsigned int bench_seed;
+
+unsigned int bench_random(){
+  bench_seed = bench_seed * 1103515245 + 12345;
+  return ( bench_seed >> 8 );
+}
+
+double now_ns(){
+  struct timespec ts;
+
+  clock_gettime( CLOCK_MONOTONIC, &ts );
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+void *fill[FILL_SLOTS];
+int use_near;
+
+void *node_alloc( void *hint, unsigned int size ){
+  return use_near ? alloc_mem_near( hint, size ) : alloc_mem( size );
+}
+
+void churn(){
+  unsigned int s = bench_random() % FILL_SLOTS;
+
+  if( fill[s] != NULL ) release_mem( fill[s] );
+  fill[s] = alloc_mem( 16 + bench_random() % MAX_REQUEST );
+}
+
+/* add the distance between two linked nodes to the totals */
+
+double link_bytes;
+unsigned long far_links;
+
+void count_link( void *a, void *b ){
+  long d = (char *) a - (char *) b;
+
+  if( d < 0 ) d = -d;
+  link_bytes += d;
+  if( (unsigned long) a / PAGE + 1 < (unsigned long) b / PAGE
+      || (unsigned long) b / PAGE + 1 < (unsigned long) a / PAGE ) far_links++;
+}
+
+void run( const char *name ){
+  struct list_node *head = NULL, *prev = NULL, *ln;
+  struct tree_node *root = NULL, **at, *parent, *tn;
+  unsigned int i, r;
+  long key, sum = 0;
+  double t, list_ns, tree_ns;
+
+  init_region_size( REGION_SIZE );
+  bench_seed = 12345;
+  near_hits = near_misses = 0;
+  for( i = 0; i < FILL_SLOTS; i++ ) fill[i] = alloc_mem( 16 + bench_random() % MAX_REQUEST );
+  for( i = 0; i < FILL_SLOTS; i++ )
+    if( bench_random() % 2 ){ release_mem( fill[i] ); fill[i] = NULL; }
+
+  for( i = 0; i < LIST_NODES; i++ ){
+    ln = (struct list_node *) node_alloc( prev, sizeof( struct list_node ) );
+    if( ln == NULL ){ printf( "no memory!\n" ); exit(0); }
+    ln->next = NULL;
+    ln->key = i;
+    if( prev != NULL ) prev->next = ln; else head = ln;
+    prev = ln;
+    churn();
+  }
+  link_bytes = 0;
+  far_links = 0;
+  for( ln = head; ln->next != NULL; ln = ln->next ) count_link( ln, ln->next );
+  printf( "   %-14s list: %9.0f bytes apart, %5.1f%% far links,", name,
+    link_bytes / ( LIST_NODES - 1 ), 100.0 * far_links / ( LIST_NODES - 1 ) );
+  t = now_ns();
+  for( r = 0; r < TRAVERSALS; r++ )
+    for( ln = head; ln != NULL; ln = ln->next ) sum += ln->key;
+  list_ns = ( now_ns() - t ) / ( (double) TRAVERSALS * LIST_NODES );
+  printf( " %5.2f ns/node\n", list_ns );
+
+  link_bytes = 0;
+  far_links = 0;
+  for( i = 0; i < TREE_NODES; i++ ){
+    key = bench_random();
+    for( at = &root, parent = NULL; *at != NULL && ( *at )->key != key; ){
+      parent = *at;
+      at = ( key < parent->key ) ? &parent->left : &parent->right;
+    }
+    if( *at == NULL ){
+      tn = (struct tree_node *) node_alloc( parent, sizeof( struct tree_node ) );
+      if( tn == NULL ){ printf( "no memory!\n" ); exit(0); }
+      tn->left = tn->right = NULL;
+      tn->key = key;
+      *at = tn;
+      if( parent != NULL ) count_link( parent, tn );
+    }
+    churn();
+  }
+  printf( "   %-14s tree: %9.0f bytes apart, %5.1f%% far links,", "",
+    link_bytes / ( TREE_NODES - 1 ), 100.0 * far_links / ( TREE_NODES - 1 ) );
+  // replay the insertion keys; the churn draws in between are replayed too
+  bench_seed = 12345;
+  for( i = 0; i < FILL_SLOTS; i++ ) bench_random();
+  for( i = 0; i < FILL_SLOTS; i++ ) bench_random();
+  for( i = 0; i < LIST_NODES; i++ ){ bench_random(); bench_random(); }
+  t = now_ns();
+  for( i = 0; i < TREE_NODES; i++ ){
+    key = bench_random();
+    for( tn = root; tn != NULL && tn->key != key; ) tn = ( key < tn->key ) ? tn->left : tn->right;
+    if( tn != NULL ) sum += tn->key;
+    bench_random();
+    bench_random();
+  }
+  tree_ns = ( now_ns() - t ) / TREE_NODES;
+  printf( " %5.1f ns/lookup\n", tree_ns );
+  if( use_near ) printf( "   %-14s %lu hinted allocations placed near, %lu fell back\n", "",
+    near_hits, near_misses );
+  if( sum == 42 ) printf( "\n" );
+  release_region();
+}
+
+int main(){
+  use_near = 0;
+  run( "alloc_mem" );
+  use_near = 1;
+  run( "alloc_mem_near" );
+  return 0;
+}
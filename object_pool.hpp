@@ -0,0 +1,127 @@
+/* CPSC/ECE 3220 typed object pool
+ *
+ * ObjectPool<T> serves objects of one type from chunks taken from a
+ * memory resource, normally the alloc_resource of alloc_resource.hpp,
+ * so that alloc_mem() is called once per chunk instead of once per
+ * object:
+ *
+ *   alloc_resource heap( 16 * 1024 * 1024 );
+ *   ObjectPool<node> pool( heap );
+ *   node *n = pool.create( key, value );   // node( key, value )
+ *   pool.destroy( n );                    // n->~node()
+ *
+ * A chunk is a link to the previous chunk followed by slots of
+ * slot_bytes bytes, each aligned for T, or to SlotAlign bytes if that
+ * is larger (heap_handle.hpp uses 16 so that every object has a
+ * handle; the default of 0 leaves the alignment of T). Slots carry no tag or header:
+ * a free slot holds the link of the intrusive free list, and a live
+ * slot holds the object. create() pops the free list, or carves the
+ * next slot of the newest chunk, and takes a new chunk only when both
+ * are exhausted; chunks double in size from first_chunk slots up to
+ * max_chunk slots. destroy() runs the destructor and pushes the slot,
+ * so in a steady state neither call reaches the general allocator.
+ *
+ * Chunks are given back only when the pool is destroyed, and objects
+ * still live at that point are not destroyed. A pool is not safe for
+ * concurrent use.
+ */
+
+#ifndef OBJECT_POOL_HPP
+#define OBJECT_POOL_HPP
+
+#include <cstddef>
+#include <new>
+#include <utility>
+#include <memory_resource>
+
+template <class T, std::size_t SlotAlign = 0>
+class ObjectPool {
+  static constexpr std::size_t object_align = SlotAlign > alignof( T ) ? SlotAlign : alignof( T );
+  union slot { slot *next; alignas( object_align ) unsigned char object[sizeof( T )]; };
+  struct chunk { chunk *prev; std::size_t slots; };
+
+public:
+  static constexpr std::size_t slot_bytes = sizeof( slot );
+  static constexpr std::size_t slot_align = alignof( slot );
+  static constexpr std::size_t chunk_header = ( sizeof( chunk ) + slot_align - 1 ) / slot_align * slot_align;
+
+  explicit ObjectPool( std::pmr::memory_resource &heap,
+                       std::size_t first_chunk = 64, std::size_t max_chunk = 4096 )
+    : heap_( &heap ), next_chunk_( first_chunk ? first_chunk : 1 ),
+      max_chunk_( max_chunk > next_chunk_ ? max_chunk : next_chunk_ ) {}
+
+  ~ObjectPool(){
+    chunk *c, *prev;
+
+    for( c = chunks_; c != nullptr; c = prev ){
+      prev = c->prev;
+      heap_->deallocate( c, chunk_header + c->slots * slot_bytes, alignment() );
+    }
+  }
+
+  ObjectPool( const ObjectPool & ) = delete;
+  ObjectPool &operator=( const ObjectPool & ) = delete;
+
+  template <class... Args>
+  T *create( Args &&... args ){
+    slot *s = take();
+    try {
+      return ::new ( static_cast<void *>( s->object ) ) T( std::forward<Args>( args )... );
+    } catch( ... ) {
+      give( s );
+      throw;
+    }
+  }
+
+  void destroy( T *ptr ){
+    if( ptr == nullptr ) return;
+    ptr->~T();
+    give( reinterpret_cast<slot *>( ptr ) );
+  }
+
+  std::size_t live() const { return live_; }
+  std::size_t capacity() const { return capacity_; }
+
+private:
+  static constexpr std::size_t alignment(){ return slot_align > 16 ? slot_align : 16; }
+
+  slot *take(){
+    slot *s = free_;
+
+    if( s != nullptr ){
+      free_ = s->next;
+    }else{
+      if( carve_ == carve_end_ ) grow();
+      s = carve_++;
+    }
+    live_++;
+    return s;
+  }
+
+  void give( slot *s ){
+    s->next = free_;
+    free_ = s;
+    live_--;
+  }
+
+  void grow(){
+    std::size_t n = next_chunk_;
+    chunk *c = static_cast<chunk *>( heap_->allocate( chunk_header + n * slot_bytes, alignment() ) );
+
+    c->prev = chunks_;
+    c->slots = n;
+    chunks_ = c;
+    carve_ = reinterpret_cast<slot *>( reinterpret_cast<char *>( c ) + chunk_header );
+    carve_end_ = carve_ + n;
+    capacity_ += n;
+    if( next_chunk_ < max_chunk_ ) next_chunk_ = ( 2 * n < max_chunk_ ) ? 2 * n : max_chunk_;
+  }
+
+  std::pmr::memory_resource *heap_;
+  std::size_t next_chunk_, max_chunk_;
+  chunk *chunks_ = nullptr;
+  slot *free_ = nullptr, *carve_ = nullptr, *carve_end_ = nullptr;
+  std::size_t live_ = 0, capacity_ = 0;
+};
+
+#endif
@@ -0,0 +1,93 @@
+/* CPSC/ECE 3220 object pool benchmark
+ *
+ * This driver churns LIVE_OBJECTS objects of a 48-byte type through
+ * OPERATIONS random destroy/create pairs, as alloc_bench.c does for
+ * raw blocks, with
+ *
+ *   new/delete      the default allocator
+ *   alloc_mem       placement new on blocks of alloc_resource.hpp
+ *   ObjectPool      object_pool.hpp on the same heap
+ *
+ * and reports the time per pair and the heap bytes per live object.
+ * The type counts its constructions and destructions, so a mismatch in
+ * the pool's handling of them shows up as a nonzero live count.
+ */
+
+#include <cstdio>
+#include <chrono>
+#include <functional>
+#include "alloc_resource.hpp"
+#include "object_pool.hpp"
+
+#define REGION_SIZE (16 * 1024 * 1024)
+#define LIVE_OBJECTS 20000
+#define OPERATIONS 1000000
+
+struct order {
+  static long alive;
+  long id;
+  double price, quantity;
+  long account, flags, stamp;
+
+  order( long i, double p ) : id( i ), price( p ), quantity( 1 ), account( 0 ), flags( 0 ), stamp( i ) { alive++; }
+  ~order(){ alive--; }
+};
+long order::alive = 0;
+
+unsigned int bench_seed;
+
+unsigned int bench_random(){
+  bench_seed = bench_seed * 1103515245 + 12345;
+  return ( bench_seed >> 8 );
+}
+
+/* fill the slots, then replace a random one OPERATIONS times */
+
+double churn( order **slot, const std::function<order *( long )> &create,
+              const std::function<void( order * )> &destroy ){
+  unsigned int i, s;
+
+  bench_seed = 12345;
+  for( i = 0; i < LIVE_OBJECTS; i++ ) slot[i] = create( i );
+  auto t0 = std::chrono::steady_clock::now();
+  for( i = 0; i < OPERATIONS; i++ ){
+    s = bench_random() % LIVE_OBJECTS;
+    destroy( slot[s] );
+    slot[s] = create( i );
+  }
+  auto t1 = std::chrono::steady_clock::now();
+  for( i = 0; i < LIVE_OBJECTS; i++ ) destroy( slot[i] );
+  return std::chrono::duration<double, std::nano>( t1 - t0 ).count() / OPERATIONS;
+}
+
+int main(){
+  static order *slot[LIVE_OBJECTS];
+  alloc_resource heap( REGION_SIZE );
+  double ns;
+  int used;
+
+  ns = churn( slot, []( long i ){ return new order( i, 1.5 ); },
+              []( order *o ){ delete o; } );
+  printf( "   new/delete  %7.1f ns per destroy/create, %ld live at end\n", ns, order::alive );
+
+  used = 0;
+  ns = churn( slot,
+    [&]( long i ){
+      order *o = new ( heap.allocate( sizeof( order ), alignof( order ) ) ) order( i, 1.5 );
+      if( i == LIVE_OBJECTS - 1 ) used = REGION_SIZE - free_size();
+      return o; },
+    [&]( order *o ){ o->~order(); heap.deallocate( o, sizeof( order ), alignof( order ) ); } );
+  printf( "   alloc_mem   %7.1f ns per destroy/create, %ld live at end, %d heap bytes per object\n",
+    ns, order::alive, used / LIVE_OBJECTS );
+
+  {
+    ObjectPool<order> pool( heap );
+    ns = churn( slot, [&]( long i ){ return pool.create( i, 1.5 ); },
+                [&]( order *o ){ pool.destroy( o ); } );
+    used = REGION_SIZE - free_size();
+    printf( "   ObjectPool  %7.1f ns per destroy/create, %ld live at end, %d heap bytes per object (%zu slots)\n",
+      ns, order::alive, used / LIVE_OBJECTS, pool.capacity() );
+  }
+  printf( "   %d bytes free in the heap after the runs\n", free_size() );
+  return 0;
+}
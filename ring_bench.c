@@ -0,0 +1,174 @@
+/* CPSC/ECE 3220 ring allocation benchmark
+ *
+ * This driver is linked with alloc.c (compiled with -DBENCH) and times
+ * a stream of messages of MSG_MIN to MSG_MAX bytes that are allocated
+ * in arrival order and released in about the same order:
+ *
+ *   1) one thread keeps IN_FLIGHT messages and releases the oldest one
+ *      before each allocation, except that one time in REORDER it
+ *      releases one of the next REORDER_SPAN messages instead, with
+ *      alloc_mem()/release_mem() and with ring_alloc()/ring_free() on a
+ *      ring of RING_BYTES bytes
+ *   2) a producer thread fills MESSAGES messages with their sequence
+ *      number and commits them, and a consumer thread reads them with
+ *      ring_next(), checks them and releases them, on a RING_SPSC ring
+ *      and on a ring that takes its mutex
+ *
+ * It reports the time per message and, for 2), the messages that
+ * arrived out of order or changed.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+
+#define REGION_SIZE (16 * 1024 * 1024)
+#define RING_BYTES (1024 * 1024)
+#define MSG_MIN 64
+#define MSG_MAX 1024
+#define IN_FLIGHT 512
+#define REORDER 8
+#define REORDER_SPAN 8
+#define STREAM 2000000
+#define MESSAGES 2000000
+
+#define RING_SPSC 1
+
+struct ring;
+
+void init_region_size( unsigned int size );
+void release_region();
+void *alloc_mem( unsigned int amount );
+unsigned int release_mem( void *ptr );
+struct ring *ring_create( unsigned int bytes, unsigned int flags );
+void ring_destroy( struct ring *r );
+void *ring_alloc( struct ring *r, unsigned int amount );
+unsigned int ring_free( struct ring *r, void *ptr );
+void ring_commit( struct ring *r, void *ptr );
+void *ring_next( struct ring *r, void *prev );
+
+unsigned int bench_seed;
+
+unsigned int bench_random(){
+  bench_seed = bench_seed * 1103515245 + 12345;
+  return ( bench_seed >> 8 );
+}
+
+double now_ns(){
+  struct timespec ts;
+
+  clock_gettime( CLOCK_MONOTONIC, &ts );
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/* 1) the stream, as a FIFO of IN_FLIGHT messages */
+
+void *fifo[IN_FLIGHT];
+
+void stream( const char *name, struct ring *r ){
+  unsigned int i, head = 0, k, amount;
+  unsigned long full = 0;
+  void *p;
+  double t;
+
+  bench_seed = 12345;
+  memset( fifo, 0, sizeof( fifo ) );
+  t = now_ns();
+  for( i = 0; i < STREAM; i++ ){
+    // release the oldest message, or now and then a slightly newer one
+    k = head;
+    if( bench_random() % REORDER == 0 ) k = ( head + bench_random() % REORDER_SPAN ) % IN_FLIGHT;
+    if( fifo[k] != NULL ){
+      if( r ) ring_free( r, fifo[k] ); else release_mem( fifo[k] );
+    }
+    fifo[k] = fifo[head];
+    fifo[head] = NULL;
+    amount = MSG_MIN + bench_random() % ( MSG_MAX - MSG_MIN + 1 );
+    p = r ? ring_alloc( r, amount ) : alloc_mem( amount );
+    if( p == NULL ) full++; else *(unsigned int *) p = i;
+    fifo[head] = p;
+    head = ( head + 1 ) % IN_FLIGHT;
+  }
+  t = now_ns() - t;
+  for( i = 0; i < IN_FLIGHT; i++ )
+    if( fifo[i] != NULL ){ if( r ) ring_free( r, fifo[i] ); else release_mem( fifo[i] ); }
+  printf( "   %-22s %6.1f ns/message, %lu allocations failed\n", name, t / STREAM, full );
+}
+
+/* 2) a producer and a consumer thread */
+
+struct ring *pipe_ring;
+unsigned long pipe_errors, pipe_stalls;
+
+void *producer( void *arg ){
+  unsigned int i, amount, seed = 777;
+  unsigned int *p;
+
+  for( i = 0; i < MESSAGES; i++ ){
+    seed = seed * 1103515245 + 12345;
+    amount = MSG_MIN + ( seed >> 8 ) % ( MSG_MAX - MSG_MIN + 1 );
+    while( ( p = (unsigned int *) ring_alloc( pipe_ring, amount ) ) == NULL ){
+      pipe_stalls++;
+      sched_yield();
+    }
+    p[0] = i;
+    p[1] = amount;
+    p[amount / 4 - 1] = ~i;
+    ring_commit( pipe_ring, p );
+  }
+  return NULL;
+}
+
+void *consumer( void *arg ){
+  unsigned int i;
+  unsigned int *p;
+
+  for( i = 0; i < MESSAGES; i++ ){
+    while( ( p = (unsigned int *) ring_next( pipe_ring, NULL ) ) == NULL ) sched_yield();
+    if( p[0] != i || p[p[1] / 4 - 1] != ~i ) pipe_errors++;
+    if( ring_free( pipe_ring, p ) ) pipe_errors++;
+  }
+  return NULL;
+}
+
+void two_threads( const char *name, unsigned int flags ){
+  pthread_t prod, cons;
+  double t;
+
+  pipe_ring = ring_create( RING_BYTES, flags );
+  if( pipe_ring == NULL ){ printf( "no memory!\n" ); exit(0); }
+  pipe_errors = pipe_stalls = 0;
+  t = now_ns();
+  pthread_create( &cons, NULL, consumer, NULL );
+  pthread_create( &prod, NULL, producer, NULL );
+  pthread_join( prod, NULL );
+  pthread_join( cons, NULL );
+  t = now_ns() - t;
+  ring_destroy( pipe_ring );
+  printf( "   %-22s %6.1f ns/message, %lu bad messages, %lu times full\n", name,
+    t / MESSAGES, pipe_errors, pipe_stalls );
+}
+
+int main(){
+  struct ring *r;
+
+  init_region_size( REGION_SIZE );
+  printf( "   one thread, %d messages of %d to %d bytes, %d in flight\n", STREAM, MSG_MIN, MSG_MAX, IN_FLIGHT );
+  stream( "alloc_mem/release_mem", NULL );
+  r = ring_create( RING_BYTES, 0 );
+  if( r == NULL ){ printf( "no memory!\n" ); return 0; }
+  stream( "ring_alloc/ring_free", r );
+  ring_destroy( r );
+  r = ring_create( RING_BYTES, RING_SPSC );
+  stream( "ring, RING_SPSC", r );
+  ring_destroy( r );
+
+  printf( "   producer and consumer threads, %d messages\n", MESSAGES );
+  two_threads( "ring, mutex", 0 );
+  two_threads( "ring, RING_SPSC", RING_SPSC );
+  release_region();
+  return 0;
+}
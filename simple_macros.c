@@ -46,14 +46,33 @@
  *   back to free; no coalescing is done in the current implementation
  * 
  * this version adds macros
+ *
+ * this version also adds a free block index so that the allocate
+ *   function does not have to step over allocated blocks; the index is
+ *   a two-level bitmap with one bit per byte offset in the area, where
+ *   a set bit means that a free block starts at that offset
+ *
+ *   free_summary   bit i set => free_map[i] != 0
+ *   free_map       bit j of word i set => free block at area + 64*i + j
+ *
+ *   the search visits only the summary words and the free blocks, in
+ *   address order, so first fit is preserved; the index is updated on
+ *   every status change (split, whole-block allocation, release)
+ *
+ * the area may be larger than one maximum-size block (e.g., compile
+ *   with -DBYTE_COUNT=65536); simple_init() then carves it into a run
+ *   of free blocks of at most MAX_PAYLOAD_SIZE bytes each
  */
 
 #include <stdio.h>
+#include <string.h>
 
 #define FREE 0
 #define ALLOCATED 1
 
+#ifndef BYTE_COUNT
 #define BYTE_COUNT 256
+#endif
 #define MIN_PAYLOAD_SIZE 2
 #define MIN_BLOCK_SIZE 6
 
@@ -70,16 +89,63 @@
 #define BOTTOM_STATUS (*(block_ptr+PAYLOAD_SIZE+3))
 #define TOP_STATUS_OF_NEXT_BLOCK (*(block_ptr+PAYLOAD_SIZE+4))
 #define TOP_SIZE_OF_NEXT_BLOCK (*(block_ptr+PAYLOAD_SIZE+5))
+#define NEXT_BLOCK (block_ptr+BLOCK_SIZE)
+
+/* size byte limits the payload to 255 */
+#define MAX_PAYLOAD_SIZE \
+  ( ( BYTE_COUNT - CONTROL_FIELDS_SIZE ) > 255 ? 255 : \
+    ( BYTE_COUNT - CONTROL_FIELDS_SIZE ) )
+
+/* macros for the free block index */
+#define MAP_WORDS ( ( BYTE_COUNT + 63 ) / 64 )
+#define SUMMARY_WORDS ( ( MAP_WORDS + 63 ) / 64 )
+#define BLOCK_OFFSET (block_ptr-area)
 
 
 unsigned char __attribute__ ((aligned (65536))) area[BYTE_COUNT];
 
+unsigned long long free_map[MAP_WORDS];
+unsigned long long free_summary[SUMMARY_WORDS];
+
+
+/* mark the block at block_ptr as present in (or absent from) the index */
+
+void index_insert( unsigned char *block_ptr ){
+  unsigned int word = BLOCK_OFFSET / 64;
+  free_map[word] |= 1ULL << ( BLOCK_OFFSET % 64 );
+  free_summary[word / 64] |= 1ULL << ( word % 64 );
+}
+
+void index_remove( unsigned char *block_ptr ){
+  unsigned int word = BLOCK_OFFSET / 64;
+  free_map[word] &= ~( 1ULL << ( BLOCK_OFFSET % 64 ) );
+  if( free_map[word] == 0 )
+    free_summary[word / 64] &= ~( 1ULL << ( word % 64 ) );
+}
 
 void simple_init(){
-  /* top status    */ area[0] = FREE;
-  /* top size      */ area[1] = BYTE_COUNT - 4;
-  /* bottom size   */ area[BYTE_COUNT - 2] = BYTE_COUNT - 4;
-  /* bottom status */ area[BYTE_COUNT - 1] = FREE;
+  unsigned char *block_ptr = area;
+  unsigned int remaining = BYTE_COUNT, payload;
+
+  memset( free_map, 0, sizeof( free_map ) );
+  memset( free_summary, 0, sizeof( free_summary ) );
+
+  while( remaining >= MIN_BLOCK_SIZE ){
+    payload = remaining - CONTROL_FIELDS_SIZE;
+    if( payload > MAX_PAYLOAD_SIZE ){
+      payload = MAX_PAYLOAD_SIZE;
+      /* leave room for a minimum-size block after this one */
+      if( remaining - payload - CONTROL_FIELDS_SIZE < MIN_BLOCK_SIZE )
+        payload -= MIN_BLOCK_SIZE;
+    }
+    TOP_STATUS = FREE;
+    TOP_SIZE = payload;
+    BOTTOM_SIZE = payload;
+    BOTTOM_STATUS = FREE;
+    index_insert( block_ptr );
+    remaining -= BLOCK_SIZE;
+    block_ptr = NEXT_BLOCK;
+  }
 }
 
 void print_blocks(){
@@ -96,52 +162,152 @@ void print_blocks(){
   }
 }
 
-unsigned char *simple_allocate( unsigned int req_size ){
-  unsigned char *block_ptr;
+/* allocate req_size bytes from the free block at block_ptr, splitting
+ *   off the bottom of the block as a new free block when possible */
+
+unsigned char *allocate_block( unsigned char *block_ptr,
+  unsigned int req_size ){
   unsigned int remaining_payload_size;
 
-  /* immediately reject requests that are too large */
-  if( req_size > BYTE_COUNT - CONTROL_FIELDS_SIZE ) return NULL;
+  if( ( PAYLOAD_SIZE - req_size ) < ( MIN_BLOCK_SIZE ) ){
+    TOP_STATUS = ALLOCATED;
+    BOTTOM_STATUS = ALLOCATED;
+    index_remove( block_ptr );
+    return ( USER_PTR );
+  }else{
+    remaining_payload_size = PAYLOAD_SIZE - req_size - CONTROL_FIELDS_SIZE;
 
-  /* start search */
-  block_ptr = area;
+    /* change bottom size before changing top size */
+    BOTTOM_SIZE = remaining_payload_size;
 
-  while( block_ptr < ( area + BYTE_COUNT ) ){
-    if( ( *block_ptr == FREE ) && ( PAYLOAD_SIZE >= req_size ) ){
-      if( ( PAYLOAD_SIZE - req_size ) < ( MIN_BLOCK_SIZE ) ){
-        TOP_STATUS = ALLOCATED;
-        BOTTOM_STATUS = ALLOCATED;
-        return ( USER_PTR );
-      }else{
-        remaining_payload_size = PAYLOAD_SIZE - req_size - CONTROL_FIELDS_SIZE;
-
-        /* change bottom size before changing top size */
-        BOTTOM_SIZE = remaining_payload_size;
-
-        TOP_STATUS = ALLOCATED;
-        TOP_SIZE = req_size;
-        BOTTOM_SIZE = req_size;
-        BOTTOM_STATUS = ALLOCATED;
-
-        TOP_STATUS_OF_NEXT_BLOCK = FREE;
-        TOP_SIZE_OF_NEXT_BLOCK = remaining_payload_size;
-
-        return ( USER_PTR );
+    TOP_STATUS = ALLOCATED;
+    TOP_SIZE = req_size;
+    BOTTOM_SIZE = req_size;
+    BOTTOM_STATUS = ALLOCATED;
+
+    TOP_STATUS_OF_NEXT_BLOCK = FREE;
+    TOP_SIZE_OF_NEXT_BLOCK = remaining_payload_size;
+
+    index_remove( block_ptr );
+    index_insert( NEXT_BLOCK );
+
+    return ( USER_PTR );
+  }
+}
+
+/* return the first free block in address order with a payload of at
+ *   least req_size bytes, visiting only the free blocks, or NULL */
+
+unsigned char *index_first_fit( unsigned int req_size ){
+  unsigned char *block_ptr;
+  unsigned int s, word;
+  unsigned long long summary, bits;
+
+  for( s = 0; s < SUMMARY_WORDS; s++ ){
+    summary = free_summary[s];
+    while( summary != 0 ){
+      word = s * 64 + __builtin_ctzll( summary );
+      summary &= summary - 1;
+      bits = free_map[word];
+      while( bits != 0 ){
+        block_ptr = area + word * 64 + __builtin_ctzll( bits );
+        bits &= bits - 1;
+        if( PAYLOAD_SIZE >= req_size ) return block_ptr;
       }
     }
-    block_ptr += BLOCK_SIZE;
   }
 
   return NULL;
 }
 
+unsigned char *simple_allocate( unsigned int req_size ){
+  unsigned char *block_ptr;
+
+  /* immediately reject requests that are too large */
+  if( req_size > MAX_PAYLOAD_SIZE ) return NULL;
+
+  /* start search, visiting only the free blocks in address order */
+  block_ptr = index_first_fit( req_size );
+  if( block_ptr == NULL ) return NULL;
+  return allocate_block( block_ptr, req_size );
+}
+
 void simple_release( unsigned char *user_ptr ){
   unsigned char *block_ptr = user_ptr - HEADER_SIZE;
   TOP_STATUS = FREE;
   BOTTOM_STATUS = FREE;
+  index_insert( block_ptr );
 }
 
 
+#ifdef BENCH
+
+/* benchmark driver
+ *
+ * fills most of the area with minimum-size blocks and releases every
+ * eighth one, leaving small holes that cannot satisfy the requests and
+ * a run of large free blocks at the end; then times first-fit searches
+ * through the index against a walk over every block as done by the
+ * original simple_allocate(); neither loop allocates, since
+ * simple_release() does not coalesce and repeated splits would pile up
+ * small free blocks during the run
+ */
+
+#include <time.h>
+
+#define SEARCHES 20000
+
+unsigned char *walk_first_fit( unsigned int req_size ){
+  unsigned char *block_ptr = area;
+  while( block_ptr < ( area + BYTE_COUNT ) ){
+    if( ( TOP_STATUS == FREE ) && ( PAYLOAD_SIZE >= req_size ) )
+      return block_ptr;
+    block_ptr += BLOCK_SIZE;
+  }
+  return NULL;
+}
+
+double elapsed_ns( struct timespec *t0, struct timespec *t1 ){
+  return ( t1->tv_sec - t0->tv_sec ) * 1e9 + ( t1->tv_nsec - t0->tv_nsec );
+}
+
+int main(){
+  static unsigned char *p[BYTE_COUNT / MIN_BLOCK_SIZE];
+  struct timespec t0, t1;
+  unsigned int i, live = 0, freed = 0;
+  unsigned char * volatile sink;
+
+  simple_init();
+  while( live < BYTE_COUNT / MIN_BLOCK_SIZE - 2048 / MIN_BLOCK_SIZE ){
+    p[live] = simple_allocate( MIN_PAYLOAD_SIZE );
+    if( p[live] == NULL ) break;
+    live++;
+  }
+  for( i = 0; i < live; i += 8 ){ simple_release( p[i] ); freed++; }
+
+  printf( "area of %d bytes, %u blocks, %u free\n", BYTE_COUNT, live, freed );
+
+  /* both loops only search, so the heap shape does not change */
+  clock_gettime( CLOCK_MONOTONIC, &t0 );
+  for( i = 0; i < SEARCHES; i++ )
+    sink = index_first_fit( MIN_PAYLOAD_SIZE + 1 + ( i % 4 ) );
+  clock_gettime( CLOCK_MONOTONIC, &t1 );
+  printf( "indexed search: %8.1f ns per search\n",
+    elapsed_ns( &t0, &t1 ) / SEARCHES );
+
+  clock_gettime( CLOCK_MONOTONIC, &t0 );
+  for( i = 0; i < SEARCHES; i++ )
+    sink = walk_first_fit( MIN_PAYLOAD_SIZE + 1 + ( i % 4 ) );
+  clock_gettime( CLOCK_MONOTONIC, &t1 );
+  printf( "block walk:     %8.1f ns per search\n",
+    elapsed_ns( &t0, &t1 ) / SEARCHES );
+  (void) sink;
+
+  return 0;
+}
+
+#else
+
 /* test driver */
 
 int main(){
@@ -170,3 +336,5 @@ int main(){
 
   return 0;
 }
+
+#endif